@@ -0,0 +1,102 @@
+// Lazy heap allocation.  Each of ROUNDS children mallocs a large
+// array, touches one page in every stride, and exits; prints the
+// ticks spent in malloc and in touching, and how many pages sbrk
+// added to the heap against how many were touched.  With the heap
+// allocated up front (stock xv6) malloc zeroes and maps every one of
+// those pages, and an array larger than physical memory fails; with
+// lazy allocation malloc costs next to nothing and only the touched
+// pages use memory.  Run it on both kernels to compare.
+//
+// First checks running out of memory with a heap bigger than
+// physical memory: read() into all of it must fail, and touching
+// all of it must kill the process ("kill proc"), not the kernel.
+// Usage: lazytest [megabytes [stride-pages]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memlayout.h"
+
+#define PGSIZE  4096
+#define ROUNDS  10
+#define HUGE    (PHYSTOP + 16*1024*1024)
+
+void
+oomcheck(void)
+{
+  int fds[2];
+  char *a;
+  uint j;
+
+  pipe(fds);
+  if(fork() == 0){
+    if((a = sbrk(HUGE)) == (char*)-1){
+      printf(1, "lazytest: no lazy heap, out-of-memory checks skipped\n");
+      exit();
+    }
+    write(fds[1], "x", 1);
+    if(read(fds[0], a, HUGE) >= 0)
+      printf(1, "lazytest: read into %d MB of heap worked\n",
+             HUGE / (1024*1024));
+    for(j = 0; j < HUGE; j += PGSIZE)
+      a[j] = 1;
+    printf(1, "lazytest: touched %d MB of heap\n", HUGE / (1024*1024));
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, stride, i, j, t0, t1, t2, fds[2];
+  int res[4], sum[2];
+  char *a, *brk0;
+
+  mb = argc > 1 ? atoi(argv[1]) : 64;
+  stride = argc > 2 ? atoi(argv[2]) : 16;
+  if(stride < 1)
+    stride = 1;
+
+  oomcheck();
+
+  sum[0] = sum[1] = 0;
+  pipe(fds);
+  for(i = 0; i < ROUNDS; i++){
+    if(fork() == 0){
+      brk0 = sbrk(0);
+      t0 = uptime();
+      a = malloc(mb*1024*1024);
+      t1 = uptime();
+      if(a == 0){
+        printf(1, "lazytest: malloc of %d MB failed\n", mb);
+        res[0] = -1;
+      } else {
+        res[3] = 0;
+        for(j = 0; j < mb*1024*1024; j += stride*PGSIZE){
+          a[j] = j;
+          res[3]++;
+        }
+        t2 = uptime();
+        res[0] = t1 - t0;
+        res[1] = t2 - t1;
+        res[2] = (sbrk(0) - brk0) / PGSIZE;
+      }
+      write(fds[1], res, sizeof(res));
+      exit();
+    }
+    wait();
+    read(fds[0], res, sizeof(res));
+    if(res[0] < 0)
+      exit();
+    sum[0] += res[0];
+    sum[1] += res[1];
+  }
+  printf(1, "%d MB, touching 1 page in %d: malloc %d ticks, touch %d ticks"
+         " (total of %d runs)\n", mb, stride, sum[0], sum[1], ROUNDS);
+  printf(1, "each run: sbrk grew the heap %d pages, %d pages touched\n",
+         res[2], res[3]);
+  exit();
+}
@@ -51,10 +51,17 @@ sys_sbrk(void)
   if(argint(0, &n) < 0)
     return -1;
   addr = myproc()->sz;
-  myproc()->sz += n;
-  
-  //  if(growproc(n) < 0)
-  //    return -1;
+  if(n < 0){
+    // Shrinking frees whatever pages were touched.
+    if(growproc(n) < 0)
+      return -1;
+  } else {
+    // Growing only moves sz: lazyalloc() maps each page
+    // the first time it is touched.
+    if(addr + n < addr || addr + n > KERNBASE)
+      return -1;
+    myproc()->sz += n;
+  }
   return addr;
 }
 
@@ -233,11 +233,17 @@ consoleintr(int (*getc)(void))
 }
 
 int
-consoleread(struct inode *ip, char *dst, int n)
+consoleread(struct inode *ip, char *udst, int n)
 {
+  char buf[INPUT_BUF], *dst;
   uint target;
   int c;
 
+  // Read into buf: udst may be swapped out, and can't be
+  // faulted in with cons.lock held.
+  if(n > sizeof(buf))
+    n = sizeof(buf);
+  dst = buf;
   iunlock(ip);
   target = n;
   acquire(&cons.lock);
@@ -265,21 +271,28 @@ consoleread(struct inode *ip, char *dst, int n)
       break;
   }
   release(&cons.lock);
+  memmove(udst, buf, target - n);
   ilock(ip);
 
   return target - n;
 }
 
 int
-consolewrite(struct inode *ip, char *buf, int n)
+consolewrite(struct inode *ip, char *ubuf, int n)
 {
-  int i;
+  char buf[128];
+  int i, j, m;
 
+  // Copy through buf, as in consoleread.
   iunlock(ip);
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
-  release(&cons.lock);
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(buf) ? n - i : sizeof(buf);
+    memmove(buf, ubuf + i, m);
+    acquire(&cons.lock);
+    for(j = 0; j < m; j++)
+      consputc(buf[j] & 0xff);
+    release(&cons.lock);
+  }
   ilock(ip);
 
   return n;
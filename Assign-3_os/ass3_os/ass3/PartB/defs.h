@@ -9,7 +9,6 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
-struct rq;
 
 // bio.c
 void            binit(void);
@@ -58,6 +57,7 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf*, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -69,6 +69,11 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+char*           kallocwait(void);
+int             nfreepages(void);
+extern char     sleeping_channel;
+extern struct spinlock sleeping_channel_lock;
+extern int      sleeping_channel_count;
 
 // kbd.c
 void            kbdintr(void);
@@ -80,6 +85,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapicipi(int, int);
 void            microdelay(int);
 
 // log.c
@@ -122,16 +128,18 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 void 			create_kernel_process(const char *name, void (*entrypoint)());
-void 			swap_out_process_function();
-void 			swap_in_process_function();
-extern int swap_out_process_exists;
-extern int swap_in_process_exists;
-extern struct rq rqueue;
-extern struct rq rqueue2;
-int rpush(struct proc *p);
-struct proc* rpop();
-struct proc* rpop2();
-int rpush2(struct proc* p);
+void            aging_process_function(void) __attribute__((noreturn));
+
+// swap.c
+void            swapinit(int dev);
+int             swapalloc(int);
+void            swapfree(int);
+void            swapread(int, char*);
+void            swapreadn(int, char**, int);
+int             swapout(void);
+void            kswapdwake(void);
+int             swapfailures(void);
+void            kswapd(void) __attribute__((noreturn));
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -176,7 +184,6 @@ void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
-extern struct spinlock swap_in_lock;
 
 // uart.c
 void            uartinit(void);
@@ -190,6 +197,7 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             reclaimuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
@@ -198,9 +206,12 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
-extern 			char * sleeping_channel;
-extern struct spinlock sleeping_channel_lock;
-extern 			int sleeping_channel_count;
+void            trackuvm(pde_t*, uint);
+void            agepages(void);
+int             clockevict(char**, int*, int, int*);
+void            tlbshootdown(uint);
+int             dropswapcache(void);
+int             swapinpage(pde_t*, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
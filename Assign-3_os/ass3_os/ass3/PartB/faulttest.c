@@ -0,0 +1,79 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Page fault latency under swapping, after memtest: each child fills
+// its pages with math_func values, then reads them back in address
+// order and in random order, checking every value.  Once the
+// children's pages no longer fit in memory most reads of a page
+// fault it back in from swap, so the time per page is the fault
+// latency.  By default the children together take OVER pages more
+// than are free, so that they do not fit.
+// Usage: faulttest [pages-per-child [children]]
+
+#define PGSIZE 4096
+#define OVER   1024  // a quarter of the swap slots
+
+int math_func(int num){
+	return num*num - 4*num + 1;
+}
+
+// Check one page; returns the number of bytes that matched.
+int check(int *page, int base){
+	int matched=0;
+	for(int k=0;k<1024;k++){
+		if(page[k] == math_func(base+k))
+			matched+=4;
+	}
+	return matched;
+}
+
+// Microseconds per page for a pass over n pages; a tick is 10ms.
+int per_page(int ticks, int n){
+	return ticks*10000/n;
+}
+
+int
+main(int argc, char* argv[]){
+
+	int nchild = argc > 2 ? atoi(argv[2]) : 4;
+	if(nchild < 1)
+		nchild = 1;
+	int npages = argc > 1 ? atoi(argv[1]) : (freemem() + OVER) / nchild;
+
+	for(int i=0;i<nchild;i++){
+		if(!fork()){
+			char *mem = sbrk(npages*PGSIZE);
+			if(mem == (char*)-1){
+				printf(1, "Child %d: sbrk failed\n", i+1);
+				exit();
+			}
+			for(int j=0;j<npages;j++){
+				int *page = (int*)(mem + j*PGSIZE);
+				for(int k=0;k<1024;k++)
+					page[k] = math_func(j*1024+k);
+			}
+
+			int t0 = uptime();
+			int bad = 0;
+			for(int j=0;j<npages;j++)
+				bad += 4096 - check((int*)(mem + j*PGSIZE), j*1024);
+			int seq = uptime() - t0;
+
+			t0 = uptime();
+			for(int j=0;j<npages;j++){
+				int r = randomrange(0, npages-1);
+				bad += 4096 - check((int*)(mem + r*PGSIZE), r*1024);
+			}
+			int rnd = uptime() - t0;
+
+			printf(1, "Child %d: %d pages, sequential %d ticks (%d us/page), random %d ticks (%d us/page), %dB different\n",
+				i+1, npages, seq, per_page(seq, npages), rnd, per_page(rnd, npages), bad);
+			exit();
+		}
+	}
+
+	while(wait()!=-1);
+	exit();
+
+}
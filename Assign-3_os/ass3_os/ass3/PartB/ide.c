@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE+SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -166,3 +166,44 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Queue n bufs at once and wait for all of them.  The swapper moves
+// a page as PGSIZE/BSIZE consecutive blocks; queueing them together
+// keeps the disk busy from one block to the next.
+void
+iderwv(struct buf *b, int n)
+{
+  struct buf **pp;
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&b[i].lock))
+      panic("iderwv: buf not locked");
+    if((b[i].flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderwv: nothing to do");
+    if(b[i].dev != 0 && !havedisk1)
+      panic("iderwv: ide disk 1 not present");
+  }
+
+  acquire(&idelock);
+
+  // Append b[0..n-1] to idequeue.
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)
+    ;
+  for(i = 0; i < n; i++){
+    b[i].qnext = 0;
+    *pp = &b[i];
+    pp = &b[i].qnext;
+  }
+
+  // Start disk if necessary.
+  if(idequeue == b)
+    idestart(b);
+
+  // Wait for all of them to finish.
+  for(i = 0; i < n; i++)
+    while((b[i].flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(&b[i], &idelock);
+
+  release(&idelock);
+}
@@ -1,6 +1,11 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Memory that has never been allocated is kept as one range of
+// pages, not on the free list, so that boot doesn't touch every
+// page of it.  kalloc takes pages from the free list first and
+// from the range once the list is empty.
 
 #include "types.h"
 #include "defs.h"
@@ -22,8 +27,17 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist; 
+  char *lazy;           // never-allocated pages lazy..lazyend
+  char *lazyend;
+  int nfree;            // pages on freelist and in the range
 } kmem;
 
+// kallocwait sleeps on sleeping_channel until kswapd has freed
+// some pages.  Not kfree: it runs under ptable.lock in wait().
+struct spinlock sleeping_channel_lock;
+int sleeping_channel_count=0;
+char sleeping_channel;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -33,6 +47,7 @@ void
 kinit1(void *vstart, void *vend)
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&sleeping_channel_lock, "sleeping_channel");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -44,13 +59,23 @@ kinit2(void *vstart, void *vend)
   kmem.use_lock = 1;
 }
 
+// Add [vstart, vend) to the range of never-allocated pages.
+// kinit2's part of memory follows on from kinit1's.
 void
 freerange(void *vstart, void *vend)
 {
-  char *p;
+  char *p, *e;
+
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
-    kfree(p);
+  e = (char*)PGROUNDDOWN((uint)vend);
+  if(e <= p)
+    return;
+  if(kmem.lazy == kmem.lazyend)
+    kmem.lazy = p;
+  else if(p != kmem.lazyend)
+    panic("freerange");
+  kmem.lazyend = e;
+  kmem.nfree += (e - p) / PGSIZE;
 }
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
@@ -68,30 +93,19 @@ kfree(char *v)
     panic("kfree");
   }
 
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
-  // memset(v, 1, PGSIZE);
-  for(int i=0;i<PGSIZE;i++){
-    v[i]=1;
-  }
+  memset(v, 1, PGSIZE);
+#endif
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   if(kmem.use_lock)
     release(&kmem.lock);
-
-  //Wake up processes sleeping on sleeping channel.
-  if(kmem.use_lock)
-    acquire(&sleeping_channel_lock);
-  if(sleeping_channel_count){
-    wakeup(sleeping_channel);
-    sleeping_channel_count=0;
-  }
-  if(kmem.use_lock)
-    release(&sleeping_channel_lock);
-
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -101,14 +115,54 @@ char*
 kalloc(void)
 {
   struct run *r;
+  int low;
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
   if(r)
     kmem.freelist = r->next;
+  else if(kmem.lazy < kmem.lazyend){
+    r = (struct run*)kmem.lazy;
+    kmem.lazy += PGSIZE;
+  }
+  if(r)
+    kmem.nfree--;
+  low = kmem.nfree < FREELOW;
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(low && kmem.use_lock)
+    kswapdwake();
   return (char*)r;
 }
 
+// Like kalloc, but if memory is out wait for kswapd to free some.
+// Returns 0 only if kswapd has nothing left to evict.
+char*
+kallocwait(void)
+{
+  char *r;
+  int failed;
+
+  for(;;){
+    failed = swapfailures();
+    if((r = kalloc()) != 0)
+      return r;
+    acquire(&sleeping_channel_lock);
+    if(swapfailures() != failed){
+      release(&sleeping_channel_lock);
+      return 0;
+    }
+    sleeping_channel_count++;
+    wakeup(&sleeping_channel_count);  // kswapd sleeps on the count
+    sleep(&sleeping_channel, &sleeping_channel_lock);
+    release(&sleeping_channel_lock);
+  }
+}
+
+int
+nfreepages(void)
+{
+  return kmem.nfree;
+}
+
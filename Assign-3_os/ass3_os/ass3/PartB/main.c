@@ -18,7 +18,11 @@ extern char end[]; // first address after kernel loaded from ELF file
 int
 main(void)
 {
+  uint64 t0, tkinit;
+
+  t0 = rdtsc();
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
+  tkinit = rdtsc() - t0;
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
@@ -33,9 +37,15 @@ main(void)
   fileinit();      // file table
   ideinit();       // disk
   startothers();   // start other processors
+  tkinit -= rdtsc();
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  tkinit += rdtsc();
   userinit();      // first user process
-  // create_kernel_process("swap_out_process", &swap_out_process_function);
+  create_kernel_process("aging_process", &aging_process_function);
+  create_kernel_process("kswapd", &kswapd);
+  // In units of 1024 cycles, to print 64-bit counts with %d.
+  cprintf("boot: %d Kcycles, %d in kinit\n",
+          (uint)((rdtsc() - t0) >> 10), (uint)(tkinit >> 10));
   mpmain();        // finish this processor's setup
 
 }
@@ -95,12 +95,17 @@ struct segdesc {
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
 #define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_SWAP        0x080   // Swapped out (only when !PTE_P)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
+// Swap slot in a PTE_SWAP page table entry
+#define PTE_SLOT(pte)   ((uint)(pte) >> PTXSHIFT)
+
 #ifndef __ASSEMBLER__
 typedef uint pte_t;
 
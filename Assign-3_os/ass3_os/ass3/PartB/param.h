@@ -1,6 +1,6 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
-#define NCPU          1  // maximum number of CPUs
+#define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -11,4 +11,10 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPSIZE    32768  // size of swap area in blocks
+#define FREELOW       128  // kswapd wakes below this many free pages
+#define FREEHIGH      256  // and swaps out until this many are free
+#define SWAPCLUSTER     8  // max pages written to swap together
+#define AGEINTERVAL    10  // ticks between page aging passes
+#define AGESCAN      8192  // frames looked at per aging pass
 
@@ -7,365 +7,20 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
-#include "fcntl.h"
-#include "sleeplock.h"
-#include "fs.h"
-#include "file.h"
 
-int swap_out_process_exists=0;
-int swap_in_process_exists=0;
-
-int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
-
-int
-proc_close(int fd)
-{
-  struct file *f;
-
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
-    return -1;
-  
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
-  return 0;
-}
-
-int
-proc_write(int fd, char *p, int n)
-{
-  struct file *f;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
-    return -1;
-  return filewrite(f, p, n);
-}
-
-
-static struct inode*
-proc_create(char *path, short type, short major, short minor)
-{
-  struct inode *ip, *dp;
-  char name[DIRSIZ];
-
-  if((dp = nameiparent(path, name)) == 0)
-    return 0;
-  ilock(dp);
-
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iunlockput(dp);
-    ilock(ip);
-    if(type == T_FILE && ip->type == T_FILE)
-      return ip;
-    iunlockput(ip);
-    return 0;
-  }
-
-  if((ip = ialloc(dp->dev, type)) == 0)
-    panic("create: ialloc");
-
-  ilock(ip);
-  ip->major = major;
-  ip->minor = minor;
-  ip->nlink = 1;
-  iupdate(ip);
-
-  if(type == T_DIR){  // Create . and .. entries.
-    dp->nlink++;  // for ".."
-    iupdate(dp);
-    // No ip->nlink++ for ".": avoid cyclic ref count.
-    if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
-      panic("create dots");
-  }
-
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
-
-  iunlockput(dp);
-
-  return ip;
-}
-
-
-static int
-proc_fdalloc(struct file *f)
-{
-  int fd;
-  struct proc *curproc = myproc();
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
-int proc_open(char *path, int omode){
-
-  int fd;
-  struct file *f;
-  struct inode *ip;
-
-  begin_op();
-
-  if(omode & O_CREATE){
-    ip = proc_create(path, T_FILE, 0, 0);
-    if(ip == 0){
-      end_op();
-      return -1;
-    }
-  } else {
-    if((ip = namei(path)) == 0){
-      end_op();
-      return -1;
-    }
-    ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
-      iunlockput(ip);
-      end_op();
-      return -1;
-    }
-  }
-
-  if((f = filealloc()) == 0 || (fd = proc_fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
-    iunlockput(ip);
-    end_op();
-    return -1;
-  }
-  iunlock(ip);
-  end_op();
-
-  f->type = FD_INODE;
-  f->ip = ip;
-  f->off = 0;
-  f->readable = !(omode & O_WRONLY);
-  f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
-  return fd;
-
-}
-
-void int_to_string(int x, char *c){
-  if(x==0)
-  {
-    c[0]='0';
-    c[1]='\0';
-    return;
-  }
-  int i=0;
-  while(x>0){
-    c[i]=x%10+'0';
-    i++;
-    x/=10;
-  }
-  c[i]='\0';
-
-  for(int j=0;j<i/2;j++){
-    char a=c[j];
-    c[j]=c[i-j-1];
-    c[i-j-1]=a;
-  }
-
-}
-
-struct rq{
-  struct spinlock lock;
-  struct proc* queue[NPROC];
-  int s;
-  int e;
-};
-
-//circular request queue for swapping out requests.
-struct rq rqueue;
-
-struct proc* rpop(){
-
-  acquire(&rqueue.lock);
-  if(rqueue.s==rqueue.e){
-  	release(&rqueue.lock);
-  	return 0;
-  }
-  struct proc *p=rqueue.queue[rqueue.s];
-  (rqueue.s)++;
-  (rqueue.s)%=NPROC;
-  release(&rqueue.lock);
-
-  return p;
-}
-
-int rpush(struct proc *p){
-
-  acquire(&rqueue.lock);
-  if((rqueue.e+1)%NPROC==rqueue.s){
-  	release(&rqueue.lock);
-    return 0;
-  }
-  rqueue.queue[rqueue.e]=p;
-  rqueue.e++;
-  (rqueue.e)%=NPROC;
-  release(&rqueue.lock);
-  
-  return 1;
-}
-
-//circular request queue for swapping in requests
-struct rq rqueue2;
-
-struct proc* rpop2(){
-
-	acquire(&rqueue2.lock);
-	if(rqueue2.s==rqueue2.e){
-		release(&rqueue2.lock);
-		return 0;
-	}
-	struct proc* p=rqueue2.queue[rqueue2.s];
-	(rqueue2.s)++;
-	(rqueue2.s)%=NPROC;
-	release(&rqueue2.lock);
-	return p;
-}
-
-int rpush2(struct proc* p){
-	acquire(&rqueue2.lock);
-	if((rqueue2.e+1)%NPROC==rqueue2.s){
-		release(&rqueue2.lock);
-		return 0;
-	}
-	rqueue2.queue[rqueue2.e]=p;
-	(rqueue2.e)++;
-	(rqueue2.e)%=NPROC;
-
-	release(&rqueue2.lock);
-	return 1;
-}
-
- 
-void swap_out_process_function(){
-
-  acquire(&rqueue.lock);
-  while(rqueue.s!=rqueue.e){
-    struct proc *p=rpop();
-
-    pde_t* pd = p->pgdir;
-    for(int i=0;i<NPDENTRIES;i++){
-
-      //skip page table if accessed. chances are high, not every page table was accessed.
-      if(pd[i]&PTE_A)
-        continue;
-      //else
-      pte_t *pgtab = (pte_t*)P2V(PTE_ADDR(pd[i]));
-      for(int j=0;j<NPTENTRIES;j++){
-
-        //Skip if found
-        if((pgtab[j]&PTE_A) || !(pgtab[j]&PTE_P))
-          continue;
-        pte_t *pte=(pte_t*)P2V(PTE_ADDR(pgtab[j]));
-
-        //for file name
-        int pid=p->pid;
-        int virt = ((1<<22)*i)+((1<<12)*j);
-
-        //file name
-        char c[50];
-        int_to_string(pid,c);
-        int x=strlen(c);
-        c[x]='_';
-        int_to_string(virt,c+x+1);
-        safestrcpy(c+strlen(c),".swp",5);
-
-        // file management
-        int fd=proc_open(c, O_CREATE | O_RDWR);
-        if(fd<0){
-          cprintf("error creating or opening file: %s\n", c);
-          panic("swap_out_process");
-        }
-
-        if(proc_write(fd,(char *)pte, PGSIZE) != PGSIZE){
-          cprintf("error writing to file: %s\n", c);
-          panic("swap_out_process");
-        }
-        proc_close(fd);
-
-        kfree((char*)pte);
-        memset(&pgtab[j],0,sizeof(pgtab[j]));
-
-        //mark this page as being swapped out.
-        pgtab[j]=((pgtab[j])^(0x080));
-
-        break;
-      }
-    }
+//Kernel process that samples the accessed bits of user pages
+//into their age counters every AGEINTERVAL ticks.
+void aging_process_function(){
+  uint t0;
 
+  for(;;){
+    agepages();
+    acquire(&tickslock);
+    t0=ticks;
+    while(ticks-t0<AGEINTERVAL)
+      sleep(&ticks,&tickslock);
+    release(&tickslock);
   }
-
-  release(&rqueue.lock);
-  
-  struct proc *p;
-  if((p=myproc())==0)
-    panic("swap out process");
-
-  swap_out_process_exists=0;
-  p->parent = 0;
-  p->name[0] = '*';
-  p->killed = 0;
-  p->state = UNUSED;
-  sched();
-}
-
-int proc_read(int fd, int n, char *p)
-{
-  struct file *f;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
-  return -1;
-  return fileread(f, p, n);
-
-}
-
-void swap_in_process_function(){
-
-	acquire(&rqueue2.lock);
-	while(rqueue2.s!=rqueue2.e){
-		struct proc *p=rpop2();
-
-		int pid=p->pid;
-		int virt=PTE_ADDR(p->addr);
-
-		char c[50];
-	    int_to_string(pid,c);
-	    int x=strlen(c);
-	    c[x]='_';
-	    int_to_string(virt,c+x+1);
-	    safestrcpy(c+strlen(c),".swp",5);
-
-	    int fd=proc_open(c,O_RDONLY);
-	    if(fd<0){
-	    	release(&rqueue2.lock);
-	    	cprintf("could not find page file in memory: %s\n", c);
-	    	panic("swap_in_process");
-	    }
-	    char *mem=kalloc();
-	    proc_read(fd,PGSIZE,mem);
-
-	    if(mappages(p->pgdir, (void *)virt, PGSIZE, V2P(mem), PTE_W|PTE_U)<0){
-	    	release(&rqueue2.lock);
-	    	panic("mappages");
-	    }
-	    wakeup(p);
-	}
-
-    release(&rqueue2.lock);
-    struct proc *p;
-	if((p=myproc())==0)
-	  panic("swap_in_process");
-
-	swap_in_process_exists=0;
-	p->parent = 0;
-	p->name[0] = '*';
-	p->killed = 0;
-	p->state = UNUSED;
-	sched();
-
 }
 
 struct {
@@ -385,9 +40,6 @@ void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
-  initlock(&rqueue.lock, "rqueue");
-  initlock(&sleeping_channel_lock, "sleeping_channel");
-  initlock(&rqueue2.lock, "rqueue2");
 }
 
 // Must be called with interrupts disabled
@@ -493,8 +145,9 @@ void create_kernel_process(const char *name, void (*entrypoint)()){
   //This is a kernel process. Trap frame stores user space registers. We don't need to initialise tf.
   //Also, since this doesn't need to have a userspace, we don't need to assign a size to this process.
 
-  //eip stores address of next instruction to be executed
-  p->context->eip = (uint)entrypoint;
+  //Start in forkret like any new process, so ptable.lock is released,
+  //but have it return to entrypoint instead of trapret.
+  *(uint*)(p->context+1) = (uint)entrypoint;
 
   safestrcpy(p->name, name, sizeof(p->name));
 
@@ -509,16 +162,6 @@ void create_kernel_process(const char *name, void (*entrypoint)()){
 void
 userinit(void)
 {
-  acquire(&rqueue.lock);
-  rqueue.s=0;
-  rqueue.e=0;
-  release(&rqueue.lock);
-
-  acquire(&rqueue2.lock);
-  rqueue2.s=0;
-  rqueue2.e=0;
-  release(&rqueue2.lock);
-
   struct proc *p;
   extern char _binary_initcode_start[], _binary_initcode_size[];
 
@@ -736,36 +379,9 @@ scheduler(void)
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-
-      //If the swap out process has stopped running, free its stack and name.
-      if(p->state==UNUSED && p->name[0]=='*'){
-
-        kfree(p->kstack);
-        p->kstack=0;
-        p->name[0]=0;
-        p->pid=0;
-      }
-
       if(p->state != RUNNABLE)
         continue;
 
-      for(int i=0;i<NPDENTRIES;i++){
-        //If PDE was accessed
-
-        if(((p->pgdir)[i])&PTE_P && ((p->pgdir)[i])&PTE_A){
-
-          pte_t* pgtab = (pte_t*)P2V(PTE_ADDR((p->pgdir)[i]));
-
-          for(int j=0;j<NPTENTRIES;j++){
-            if(pgtab[j]&PTE_A){
-              pgtab[j]^=PTE_A;
-            }
-          }
-
-          ((p->pgdir)[i])^=PTE_A;
-        }
-      }
-
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
@@ -838,6 +454,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
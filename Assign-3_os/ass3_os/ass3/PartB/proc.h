@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint tlbflushes;    // TLB shootdown IPIs handled
 };
 
 extern struct cpu cpus[NCPU];
@@ -49,7 +50,6 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  int addr;                    // ADDED: Virtual address of pagefault
 
 };
 
@@ -0,0 +1,244 @@
+// Swap area.
+//
+// Swapped-out pages live in a raw region of the disk just past the
+// file system (see mkfs.c), not in files.  A slot is PGSIZE/BSIZE
+// consecutive blocks, and an in-memory bitmap records which slots
+// are in use.  Swap I/O goes straight to the disk driver through
+// private bufs, bypassing the buffer cache, the log and the
+// directory tree.
+//
+// A swapped-out page keeps its slot number in the PTE_ADDR bits of
+// its (non-present) PTE, marked with PTE_SWAP.
+//
+// kswapd keeps memory free ahead of demand: kalloc wakes it when
+// fewer than FREELOW pages are left, and it evicts clusters of up to
+// SWAPCLUSTER virtually contiguous pages to contiguous slots, each
+// cluster written with one queue of disk requests, until FREEHIGH
+// pages are free.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define BPP   (PGSIZE/BSIZE)  // blocks per slot
+#define NSLOT (SWAPSIZE/BPP)
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;           // first block of the swap area
+  int nslot;
+  uchar map[NSLOT/8];   // one bit per slot, set if in use
+  int failed;           // times kswapd found nothing to evict
+  struct buf buf[SWAPCLUSTER*BPP];  // their sleeplocks serialize swap I/O
+} swap;
+
+#define INUSE(s) (swap.map[(s)/8] & (1 << ((s)%8)))
+
+// Called from forkret, once the superblock can be read.
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+  int i;
+
+  initlock(&swap.lock, "swap");
+  for(i = 0; i < NELEM(swap.buf); i++)
+    initsleeplock(&swap.buf[i].lock, "swapbuf");
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / BPP;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  cprintf("swap: start %d slots %d\n", swap.start, swap.nslot);
+}
+
+// Allocate n contiguous swap slots.  Returns the first,
+// or -1 if there is no run of n free slots.
+int
+swapalloc(int n)
+{
+  int s, i;
+
+  acquire(&swap.lock);
+  for(s = 0; s + n <= swap.nslot; s++){
+    for(i = 0; i < n && !INUSE(s+i); i++)
+      ;
+    if(i == n){
+      for(i = 0; i < n; i++)
+        swap.map[(s+i)/8] |= 1 << ((s+i)%8);
+      release(&swap.lock);
+      return s;
+    }
+    s += i;
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+void
+swapfree(int s)
+{
+  acquire(&swap.lock);
+  if(s < 0 || s >= swap.nslot || !INUSE(s))
+    panic("swapfree");
+  swap.map[s/8] &= ~(1 << (s%8));
+  release(&swap.lock);
+}
+
+// Point the (locked) bufs for n slots at slots s..s+n-1.
+static void
+aimbufs(int s, int n)
+{
+  struct buf *b;
+  int i;
+
+  if(s < 0 || s + n > swap.nslot || n > SWAPCLUSTER)
+    panic("swap slot");
+  for(i = 0; i < n*BPP; i++){
+    b = &swap.buf[i];
+    b->dev = swap.dev;
+    b->blockno = swap.start + s*BPP + i;
+  }
+}
+
+// Lock the bufs for n slots and point them at slots s..s+n-1.
+static void
+lockbufs(int s, int n)
+{
+  int i;
+
+  for(i = 0; i < n*BPP; i++)
+    acquiresleep(&swap.buf[i].lock);
+  aimbufs(s, n);
+}
+
+static void
+unlockbufs(int n)
+{
+  int i;
+
+  for(i = 0; i < n*BPP; i++)
+    releasesleep(&swap.buf[i].lock);
+}
+
+// Read slots s..s+n-1 into pages[0..n-1], queued together.
+void
+swapreadn(int s, char **pages, int n)
+{
+  int i;
+
+  lockbufs(s, n);
+  for(i = 0; i < n*BPP; i++)
+    swap.buf[i].flags = 0;
+  iderwv(swap.buf, n*BPP);
+  for(i = 0; i < n*BPP; i++)
+    memmove(pages[i/BPP] + (i%BPP)*BSIZE, swap.buf[i].data, BSIZE);
+  unlockbufs(n);
+}
+
+void
+swapread(int s, char *page)
+{
+  swapreadn(s, &page, 1);
+}
+
+// Evict a cluster of pages, chosen by clockevict, to contiguous
+// slots.  The pages are copied into the swap bufs while they are
+// locked and then freed, so a fault on one of them that comes in
+// while the write is still in progress waits for the bufs and reads
+// the new data.  Returns the number of pages evicted.
+int
+swapout(void)
+{
+  char *pages[SWAPCLUSTER];
+  int s, slot, n, got, clean, i;
+
+  n = SWAPCLUSTER;
+  while((s = swapalloc(n)) < 0){
+    // Out of slots: the swap cache of resident pages can go.
+    if(n == 1 && dropswapcache() > 0)
+      continue;
+    if((n /= 2) == 0)
+      return 0;
+  }
+  lockbufs(s, n);
+  slot = s;
+  got = clockevict(pages, &slot, n, &clean);
+  if(slot != s){
+    // Back to the slot it came from; the new ones aren't needed.
+    for(i = 0; i < n; i++)
+      swapfree(s + i);
+    // Unless it was written to while being evicted, it is
+    // already there: nothing to write.
+    aimbufs(slot, 1);
+  } else {
+    for(i = got; i < n; i++)
+      swapfree(s + i);
+  }
+  if(got > 0 && !clean){
+    for(i = 0; i < got*BPP; i++){
+      memmove(swap.buf[i].data, pages[i/BPP] + (i%BPP)*BSIZE, BSIZE);
+      swap.buf[i].flags = B_DIRTY;
+    }
+  }
+  for(i = 0; i < got; i++)
+    kfree(pages[i]);
+  if(got > 0 && !clean)
+    iderwv(swap.buf, got*BPP);
+  unlockbufs(n);
+  return got;
+}
+
+// Called by kalloc when free memory is below FREELOW.
+void
+kswapdwake(void)
+{
+  acquire(&sleeping_channel_lock);
+  wakeup(&sleeping_channel_count);
+  release(&sleeping_channel_lock);
+}
+
+int
+swapfailures(void)
+{
+  return swap.failed;
+}
+
+// Kernel process started from main.  It sleeps on
+// sleeping_channel_count under sleeping_channel_lock, and wakes
+// the processes in kallocwait after each pass.
+void
+kswapd(void)
+{
+  int failed;
+
+  for(;;){
+    acquire(&sleeping_channel_lock);
+    while(nfreepages() >= FREELOW && sleeping_channel_count == 0)
+      sleep(&sleeping_channel_count, &sleeping_channel_lock);
+    release(&sleeping_channel_lock);
+
+    failed = 0;
+    while(nfreepages() < FREEHIGH && !failed)
+      failed = swapout() == 0;
+    acquire(&sleeping_channel_lock);
+    if(failed)
+      swap.failed++;  // tell kallocwait not to wait for us
+    sleeping_channel_count = 0;
+    wakeup(&sleeping_channel);
+    release(&sleeping_channel_lock);
+    if(failed){
+      // Don't spin while memory stays short; try again next tick.
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+    }
+  }
+}
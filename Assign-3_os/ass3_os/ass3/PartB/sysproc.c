@@ -89,3 +89,10 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// return how many physical pages are free.
+int
+sys_freemem(void)
+{
+  return nfreepages();
+}
@@ -14,28 +14,42 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 
-struct spinlock swap_in_lock;
-
-void handlePageFault(){
-  int addr=rcr2();
-  struct proc *p=myproc();
-  acquire(&swap_in_lock);
-  sleep(p,&swap_in_lock);
-  pde_t *pde = &(p->pgdir)[PDX(addr)];
-  pte_t *pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+// A fault on a swapped-out page brings it back in, right here in
+// the faulting process.  Any other fault is handled like other
+// unexpected traps.  A system call that faults on a user page that
+// cannot be brought in, with memory and swap both exhausted, kills
+// its process rather than the kernel, and is let finish on pages
+// taken from the process itself.
+static int
+pagefault(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+  uint va;
 
-  if((pgtab[PTX(addr)])&0x080){
-    //This means that the page was swapped out.
-    //virtual address for page
-    p->addr = addr;
-    rpush2(p);
-    if(!swap_in_process_exists){
-      swap_in_process_exists=1;
-      create_kernel_process("swap_in_process", &swap_in_process_function);
+  if(p == 0 || p->pgdir == 0)
+    return -1;
+  if(mycpu()->ncli > 0){
+    // Cannot sleep for the disk while holding a spinlock.
+    cprintf("page fault with lock held, eip %x (cr2=0x%x)\n", tf->eip, rcr2());
+    return -1;
+  }
+  va = rcr2();
+  while(swapinpage(p->pgdir, va) < 0){
+    if((tf->cs&3) == DPL_USER || va >= p->sz)
+      return -1;
+    if(!p->killed){
+      cprintf("pid %d %s: out of memory at addr 0x%x in kernel--kill proc\n",
+              p->pid, p->name, va);
+      p->killed = 1;
+    }
+    switch(reclaimuvm(p->pgdir, p->sz, va)){
+    case -1:
+      return -1;
+    case 0:
+      return 0;
     }
-  } else {
-    exit();
   }
+  return 0;
 }
 
 void
@@ -95,6 +109,11 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    lcr3(rcr3());
+    mycpu()->tlbflushes++;
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -102,8 +121,9 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
   case T_PGFLT:
-    handlePageFault();
-  break;
+    if(pagefault(tf) == 0)
+      break;
+    // fall through
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -128,9 +148,9 @@ trap(struct trapframe *tf)
 
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
-  // if(myproc() && myproc()->state == RUNNING &&
-  //    tf->trapno == T_IRQ0+IRQ_TIMER)
-  //   yield();
+  if(myproc() && myproc()->state == RUNNING &&
+     tf->trapno == T_IRQ0+IRQ_TIMER)
+    yield();
 
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
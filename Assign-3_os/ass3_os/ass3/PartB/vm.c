@@ -7,13 +7,29 @@
 #include "proc.h"
 #include "elf.h"
 #include "spinlock.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
-struct spinlock sleeping_channel_lock;
-int sleeping_channel_count=0;
-char * sleeping_channel;
+// Frame table: which address space maps each resident user page,
+// so page replacement can choose among all processes' pages.
+struct frame {
+  pde_t *pgdir;  // 0 if not a tracked user page
+  uint va;
+  uchar age;     // PTE_A history from the aging thread, newest in bit 7
+  int slot;      // swap slot with a copy of the page, or -1
+};
+
+struct {
+  struct spinlock lock;
+  struct frame frame[PHYSTOP/PGSIZE];
+  uint hand;     // clock hand
+  uint agehand;  // where the next aging pass starts
+} frames;
+
+#define EVICTSCAN 32    // tracked frames clockevict looks at
+#define COLDAGE   0x20  // pages aged below this join a cluster
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -145,6 +161,7 @@ setupkvm(void)
 void
 kvmalloc(void)
 {
+  initlock(&frames.lock, "frames");
   kpgdir = setupkvm();
   switchkvm();
 }
@@ -182,6 +199,291 @@ switchuvm(struct proc *p)
   popcli();
 }
 
+// Record that pgdir maps the user page at pa at va.  slot is the
+// swap slot the page was just read from, or -1.
+static void
+track(pde_t *pgdir, uint va, uint pa, int slot)
+{
+  acquire(&frames.lock);
+  frames.frame[pa/PGSIZE].pgdir = pgdir;
+  frames.frame[pa/PGSIZE].va = va;
+  frames.frame[pa/PGSIZE].age = 0x80;
+  frames.frame[pa/PGSIZE].slot = slot;
+  release(&frames.lock);
+}
+
+// Drop f's copy in swap, if it has one.  Caller holds frames.lock.
+static void
+dropslot(struct frame *f)
+{
+  if(f->slot >= 0){
+    swapfree(f->slot);
+    f->slot = -1;
+  }
+}
+
+// Free the swap copies of all resident pages, for when swap is
+// full.  Returns how many were freed.
+int
+dropswapcache(void)
+{
+  struct frame *f;
+  int n;
+
+  n = 0;
+  acquire(&frames.lock);
+  for(f = frames.frame; f < &frames.frame[NELEM(frames.frame)]; f++){
+    if(f->pgdir && f->slot >= 0){
+      dropslot(f);
+      n++;
+    }
+  }
+  release(&frames.lock);
+  return n;
+}
+
+// Make the resident user pages of pgdir below sz candidates for
+// replacement.  exec calls this once it commits to a new image:
+// until then loaduvm and copyout write its pages through kernel
+// addresses and may sleep in between, so they must not be evicted.
+void
+trackuvm(pde_t *pgdir, uint sz)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = 0; a < sz; a += PGSIZE)
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) != 0 && (*pte & PTE_P))
+      track(pgdir, a, PTE_ADDR(*pte), -1);
+}
+
+// One pass of the aging thread: shift the PTE_A bit of each of the
+// next AGESCAN frames into its age counter and clear it.  The older
+// a page's last use, the smaller its age.
+void
+agepages(void)
+{
+  struct frame *f;
+  pte_t *pte;
+  int n;
+
+  acquire(&frames.lock);
+  for(n = 0; n < AGESCAN; n++){
+    f = &frames.frame[frames.agehand];
+    frames.agehand = (frames.agehand + 1) % NELEM(frames.frame);
+    if(f->pgdir == 0)
+      continue;
+    if((pte = walkpgdir(f->pgdir, (char*)f->va, 0)) == 0)
+      panic("agepages");
+    f->age >>= 1;
+    if(*pte & PTE_A){
+      f->age |= 0x80;
+      // Atomically: another CPU may be setting PTE_D.  TLBs are not
+      // flushed, so a page stays "used" in a TLB until its next flush;
+      // with timer preemption that is at most a tick away.
+      __sync_fetch_and_and(pte, ~PTE_A);
+    }
+  }
+  release(&frames.lock);
+}
+
+// If the page at va in pgdir is a cold, tracked user page that
+// may be swapped out with a cluster, return its PTE.
+// Caller holds frames.lock.
+static pte_t*
+coldpte(pde_t *pgdir, uint va)
+{
+  struct frame *f;
+  pte_t *pte;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0)
+    return 0;
+  if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U) || (*pte & PTE_A))
+    return 0;
+  f = &frames.frame[PTE_ADDR(*pte)/PGSIZE];
+  if(f->pgdir != pgdir || f->age >= COLDAGE)
+    return 0;
+  if(f->slot >= 0 && (*pte & PTE_D) == 0)
+    return 0;  // evicted on its own, for free
+  return pte;
+}
+
+// The other CPUs running with pgdir loaded, as a mask of cpus[]
+// indexes.  Caller holds a spinlock, so it stays on this CPU.
+static uint
+tlbusers(pde_t *pgdir)
+{
+  struct cpu *c;
+  uint mask;
+
+  mask = 0;
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != mycpu() && c->proc && c->proc->pgdir == pgdir)
+      mask |= 1 << (c - cpus);
+  return mask;
+}
+
+// Flush the TLBs of the CPUs in mask and wait until they have.
+// Call with no spinlock held and interrupts on: a CPU spinning for a
+// lock with interrupts off could not take the IPI, and two CPUs
+// shooting down at the same time must each take the other's.
+void
+tlbshootdown(uint mask)
+{
+  uint seen[NCPU];
+  int i;
+
+  for(i = 0; i < ncpu; i++){
+    if(mask & (1 << i)){
+      seen[i] = cpus[i].tlbflushes;
+      lapicipi(cpus[i].apicid, T_TLBFLUSH);
+    }
+  }
+  for(i = 0; i < ncpu; i++)
+    if(mask & (1 << i))
+      while(cpus[i].tlbflushes == seen[i])
+        ;
+}
+
+// Point the PTE of a page being evicted at slot s.  Returns the old
+// PTE, swapped out atomically so that a PTE_D set by another CPU's
+// MMU is not lost.  Caller holds frames.lock.
+static pte_t
+swappte(pde_t *pgdir, uint va, pte_t *pte, int s)
+{
+  pte_t old;
+
+  old = xchg(pte, (s << PTXSHIFT) | PTE_SWAP | (*pte & (PTE_W|PTE_U)));
+  if(myproc() && myproc()->pgdir == pgdir)
+    invlpg((char*)va);
+  return old;
+}
+
+// Choose up to n user pages to evict, from any process.  The clock
+// hand moves over the next EVICTSCAN tracked frames and takes the
+// one with the smallest age, passing over pages used since the last
+// aging pass unless there is nothing else.  Cold pages on either
+// side of the victim in the same address space join it, so that a
+// cluster of virtually contiguous pages goes to contiguous slots.
+// Their PTEs are replaced by swapped-out PTEs for slots *slot,
+// *slot+1, ... in address order.  Fills in pages[] with the victims'
+// frames, still allocated, for the caller to write out and free, and
+// returns how many there are: 0 if there are no user pages to evict.
+//
+// A victim that is clean and still has its copy in swap from when
+// it was last swapped in goes back to that slot on its own instead;
+// then *slot is that slot, and *clean is set unless the page was
+// written to while its PTE was being replaced.
+//
+// Other CPUs' TLBs are flushed of the victims before this returns,
+// so nothing can write to them any more.
+int
+clockevict(char **pages, int *slot, int n, int *clean)
+{
+  struct frame *f, *victim;
+  pte_t *pte, *vpte;
+  uint i, k, age, best, lo, hi, va, pa, cpus;
+  pde_t *pgdir;
+
+  victim = 0;
+  vpte = 0;
+  best = ~0;
+  *clean = 0;
+  acquire(&frames.lock);
+  for(i = k = 0; i < NELEM(frames.frame) && k < EVICTSCAN; i++){
+    f = &frames.frame[frames.hand];
+    frames.hand = (frames.hand + 1) % NELEM(frames.frame);
+    if(f->pgdir == 0)
+      continue;
+    k++;
+    pte = walkpgdir(f->pgdir, (char*)f->va, 0);
+    if(pte == 0 || (*pte & PTE_P) == 0)
+      panic("clockevict");
+    age = (*pte & PTE_A) ? 0x100 : f->age;
+    if(age < best){
+      best = age;
+      victim = f;
+      vpte = pte;
+      if(age == 0)
+        break;
+    }
+  }
+  if(victim == 0){
+    release(&frames.lock);
+    return 0;
+  }
+
+  pgdir = victim->pgdir;
+  if(victim->slot >= 0 && (*vpte & PTE_D) == 0){
+    *slot = victim->slot;
+    pages[0] = P2V(PTE_ADDR(*vpte));
+    *clean = (swappte(pgdir, victim->va, vpte, *slot) & PTE_D) == 0;
+    victim->slot = -1;
+    victim->pgdir = 0;
+    k = 1;
+  } else {
+    // Grow the cluster around the victim.
+    lo = hi = victim->va;
+    while(hi - lo + PGSIZE < n*PGSIZE && lo > 0 && coldpte(pgdir, lo - PGSIZE))
+      lo -= PGSIZE;
+    while(hi - lo + PGSIZE < n*PGSIZE && coldpte(pgdir, hi + PGSIZE))
+      hi += PGSIZE;
+
+    for(va = lo, k = 0; va <= hi; va += PGSIZE, k++){
+      pte = va == victim->va ? vpte : coldpte(pgdir, va);
+      pa = PTE_ADDR(*pte);
+      f = &frames.frame[pa/PGSIZE];
+      dropslot(f);  // dirty: the old copy is stale
+      f->pgdir = 0;
+      swappte(pgdir, va, pte, *slot + k);
+      pages[k] = P2V(pa);
+    }
+  }
+  cpus = tlbusers(pgdir);
+  release(&frames.lock);
+  tlbshootdown(cpus);
+  return k;
+}
+
+// Bring the swapped-out page at va back into memory.  kswapd
+// writes clusters of neighbouring pages to contiguous slots, so read
+// around the fault: the pages after va that went to the slots after
+// its slot come in with it, up to SWAPCLUSTER pages in one batch, if
+// memory is not short.  Returns 0 on success, -1 if va is not
+// swapped out or there is no memory for it.
+int
+swapinpage(pde_t *pgdir, uint va)
+{
+  pte_t *pte[SWAPCLUSTER];
+  char *mem[SWAPCLUSTER];
+  int i, n, s;
+
+  va = PGROUNDDOWN(va);
+  pte[0] = walkpgdir(pgdir, (char*)va, 0);
+  if(pte[0] == 0 || (*pte[0] & (PTE_P|PTE_SWAP)) != PTE_SWAP)
+    return -1;
+  if((mem[0] = kallocwait()) == 0)
+    return -1;
+  s = PTE_SLOT(*pte[0]);
+  for(n = 1; n < SWAPCLUSTER && va + n*PGSIZE < KERNBASE; n++){
+    pte[n] = walkpgdir(pgdir, (char*)(va + n*PGSIZE), 0);
+    if(pte[n] == 0 || (*pte[n] & (PTE_P|PTE_SWAP)) != PTE_SWAP ||
+       PTE_SLOT(*pte[n]) != s + n)
+      break;
+    if(nfreepages() < FREELOW || (mem[n] = kalloc()) == 0)
+      break;
+  }
+
+  // The slots stay allocated as the pages' swap cache: while a page
+  // is clean (PTE_D clear) it can be evicted again without a write.
+  swapreadn(s, mem, n);
+  for(i = 0; i < n; i++){
+    *pte[i] = V2P(mem[i]) | (*pte[i] & (PTE_W|PTE_U)) | PTE_P;
+    track(pgdir, va + i*PGSIZE, V2P(mem[i]), s + i);
+  }
+  return 0;
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -195,6 +497,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memset(mem, 0, PGSIZE);
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
+  track(pgdir, 0, V2P(mem), -1);
 }
 
 // Load a program segment into pgdir.  addr must be page-aligned
@@ -236,24 +539,10 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kallocwait();
     if(mem == 0){
-      // cprintf("allocuvm out of memory\n");
+      cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
-
-      //SLEEP
-      myproc()->state=SLEEPING;
-      acquire(&sleeping_channel_lock);
-      myproc()->chan=sleeping_channel;
-      sleeping_channel_count++;
-      release(&sleeping_channel_lock);
-
-	     rpush(myproc());
-      if(!swap_out_process_exists){
-        swap_out_process_exists=1;
-        create_kernel_process("swap_out_process", &swap_out_process_function);
-      }
-      
       return 0;
     }
     memset(mem, 0, PGSIZE);
@@ -263,10 +552,40 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       kfree(mem);
       return 0;
     }
+    if(pgdir == myproc()->pgdir)
+      track(pgdir, a, V2P(mem), -1);
   }
   return newsz;
 }
 
+// Free the user page, resident or swapped out, that pte maps, and
+// clear pte.
+static void
+freepte(pte_t *pte)
+{
+  struct frame *f;
+  pte_t old;
+  uint pa;
+
+  // kswapd may be evicting this page: take it under frames.lock.
+  acquire(&frames.lock);
+  old = xchg(pte, 0);
+  if(old & PTE_P){
+    f = &frames.frame[PTE_ADDR(old)/PGSIZE];
+    if(f->pgdir)
+      dropslot(f);
+    f->pgdir = 0;
+  }
+  release(&frames.lock);
+  if(old & PTE_P){
+    pa = PTE_ADDR(old);
+    if(pa == 0)
+      panic("kfree");
+    kfree(P2V(pa));
+  } else if(old & PTE_SWAP)
+    swapfree(PTE_SLOT(old));
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -275,7 +594,7 @@ int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
   pte_t *pte;
-  uint a, pa;
+  uint a;
 
   if(newsz >= oldsz)
     return oldsz;
@@ -285,18 +604,51 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
-      pa = PTE_ADDR(*pte);
-      if(pa == 0)
-        panic("kfree");
-      char *v = P2V(pa);
-      kfree(v);
-      *pte = 0;
-    }
+    else if(*pte & (PTE_P|PTE_SWAP))
+      freepte(pte);
   }
   return newsz;
 }
 
+// Memory and swap are both exhausted, and the current process,
+// killed, has faulted in the kernel on the user page at va, below
+// sz, which cannot be brought in.  The system call cannot be
+// resumed without a page there, and what it reads or writes no
+// longer matters: free the process's other user pages so that va
+// can be swapped in, or if va's page was freed like this by an
+// earlier fault, give it a zeroed page.  Returns 0 if va is now
+// mapped, 1 if swapping it in should be tried again, and -1 if the
+// page is present, so that the fault was not for a missing page.
+int
+reclaimuvm(pde_t *pgdir, uint sz, uint va)
+{
+  pte_t *pte;
+  char *mem;
+  uint a;
+
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return -1;
+  for(a = 0; a < sz; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(a != va && (*pte & PTE_U) && (*pte & (PTE_P|PTE_SWAP)))
+      freepte(pte);
+  }
+  lcr3(V2P(pgdir));
+
+  if((pte = walkpgdir(pgdir, (char*)va, 0)) != 0 && (*pte & PTE_SWAP))
+    return 1;
+  if((mem = kallocwait()) == 0)
+    return 1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return 1;
+  }
+  return 0;
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -335,7 +687,7 @@ pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
+  pte_t *pte, old;
   uint pa, i, flags;
   char *mem;
 
@@ -344,18 +696,29 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
+    // kswapd may evict the page while it is being copied.
+    acquire(&frames.lock);
+    old = *pte;
+    if(old & PTE_P){
+      pa = PTE_ADDR(old);
+      flags = PTE_FLAGS(old);
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+    }
+    release(&frames.lock);
+    if(old & PTE_SWAP){
+      // The child gets its own resident copy of a swapped-out page.
+      flags = old & (PTE_W|PTE_U);
+      swapread(PTE_SLOT(old), mem);
+    } else if(!(old & PTE_P))
+      panic("copyuvm: page not present");
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
       goto bad;
     }
   }
+  trackuvm(d, sz);
   return d;
 
 bad:
@@ -0,0 +1,50 @@
+// Timing and reporting for the benchmark programs.
+// Times are in ticks of the timer, which are 10ms each.
+
+#include "types.h"
+#include "user.h"
+
+// Ticks since t0, an earlier uptime(); at least 1, so that
+// rates can be worked out from it.
+int
+benchticks(int t0)
+{
+  int t;
+
+  t = uptime() - t0;
+  return t > 0 ? t : 1;
+}
+
+// Run f(arg) in n processes at once; returns the ticks taken.
+int
+benchfork(void (*f)(int), int arg, int n)
+{
+  int i, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      f(arg);
+      exit();
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait();
+  return benchticks(t0);
+}
+
+// Print "n units in t ticks, r units/s".  Divides in two steps so
+// that large counts don't overflow.
+void
+benchrate(uint n, char *unit, int t)
+{
+  printf(1, "%d %s in %d ticks, %d %s/s\n", n, unit, t,
+         n / t * 100 + n % t * 100 / t, unit);
+}
+
+// Print "n in t ticks, u us each".
+void
+benchper(uint n, int t)
+{
+  printf(1, "%d in %d ticks, %d us each\n", n, t, (uint)t * 10000 / n);
+}
@@ -4,11 +4,17 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct execseg;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct shm;
+struct rwspinlock;
+struct rwsleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -42,9 +48,14 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockread(struct inode*);
 void            iput(struct inode*);
+char*           ipage(struct inode*, uint, uint, int);
+void            iexec(struct inode*);
+void            iexecdone(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            iunlockread(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -66,6 +77,10 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+char*           kallocorder(int);
+void            kdup(char*);
+int             krefs(char*);
+void            kfreeorder(char*, int);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -87,6 +102,16 @@ void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
 
+// mmap.c
+int             mmap(uint, int, int, struct file*, uint);
+int             mmapfault(struct proc*, uint);
+int             mmapfork(struct proc*, struct proc*);
+int             mmapoverlap(struct proc*, uint, uint);
+int             mmapped(struct proc*, uint, uint);
+int             munmap(uint, uint);
+void            munmapall(struct proc*);
+struct vma*     vmaalloc(struct proc*, uint, uint);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -96,6 +121,7 @@ void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -133,6 +159,34 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// rwlock.c
+void            acquireread(struct rwspinlock*);
+void            acquirewrite(struct rwspinlock*);
+int             holdingwrite(struct rwspinlock*);
+void            initrwlock(struct rwspinlock*, char*);
+void            releaseread(struct rwspinlock*);
+void            releasewrite(struct rwspinlock*);
+void            acquirereadsleep(struct rwsleeplock*);
+void            acquirewritesleep(struct rwsleeplock*);
+int             holdingwritesleep(struct rwsleeplock*);
+void            initrwsleeplock(struct rwsleeplock*, char*);
+void            releasereadsleep(struct rwsleeplock*);
+void            releasewritesleep(struct rwsleeplock*);
+
+// shm.c
+void            shminit(void);
+int             shmat(int, uint);
+void            shmdup(struct shm*);
+int             shmdt(uint);
+int             shmget(int, uint);
+void            shmput(struct shm*);
+int             shmrm(int);
+
+// slab.c
+struct slabcache* slabcreate(char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -151,6 +205,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argwptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -173,18 +228,24 @@ void            uartputc(int);
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
+void            kvmglobal(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+int             execfault(struct proc*, uint);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
+void            mapcached(pde_t*, struct inode*, struct execseg*);
+int             pagein(struct proc*, uint, uint, int);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             cowfault(pde_t*, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
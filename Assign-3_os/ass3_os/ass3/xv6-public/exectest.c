@@ -0,0 +1,71 @@
+// Exec latency for a program much of which never runs: this
+// binary carries BIG bytes of initialized data.  Times fork+exec
+// of itself with "-", which exits straight away, and with "+",
+// which first reads all of that data.  With executables paged in
+// on demand the first costs only the pages that run; with exec
+// reading the whole binary both cost the same.  Also checks that
+// the binary can't be written while it runs, since its pages are
+// still read from the file.
+// Usage: exectest [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define BIG (40*1024)
+
+char big[BIG] = { 1 };
+
+int
+run(char *arg, int n)
+{
+  char *args[] = { "exectest", arg, 0 };
+  int i, t;
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      exec(args[0], args);
+      printf(1, "exectest: exec failed\n");
+      exit();
+    }
+    wait();
+  }
+  return benchticks(t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, fd;
+  char c;
+  volatile int sum;
+
+  if(argc > 1 && strcmp(argv[1], "-") == 0)
+    exit();
+  if(argc > 1 && strcmp(argv[1], "+") == 0){
+    sum = 0;
+    for(i = 0; i < BIG; i += 512)
+      sum += big[i];
+    exit();
+  }
+
+  // Write back the byte that is there, in case the write works.
+  if((fd = open("exectest", O_RDONLY)) >= 0){
+    read(fd, &c, 1);
+    close(fd);
+  }
+  if((fd = open("exectest", O_RDWR)) >= 0){
+    if(write(fd, &c, 1) >= 0)
+      printf(1, "exectest: wrote to a running executable\n");
+    close(fd);
+  }
+
+  n = argc > 1 ? atoi(argv[1]) : 100;
+  printf(1, "exec, data untouched: ");
+  benchper(n, run("-", n));
+  printf(1, "exec, data read:      ");
+  benchper(n, run("+", n));
+  exit();
+}
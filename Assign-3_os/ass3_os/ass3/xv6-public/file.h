@@ -9,12 +9,15 @@ struct file {
 };
 
 
+#define NIPAGE 20  // cached executable pages per inode, enough for MAXFILE
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
-  struct sleeplock lock; // protects everything below here
+  struct inode *next; // on the icache list
+  struct rwsleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
   short type;         // copy of disk inode
@@ -23,6 +26,13 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  int nexec;          // processes running it; see iexec()
+  struct {            // pages of the file mapped by exec; see ipage()
+    uint off;         // holds file bytes [off, off+n), then zeros
+    uint n;
+    char *page;
+  } pages[NIPAGE];
 };
 
 // table mapping major device number to
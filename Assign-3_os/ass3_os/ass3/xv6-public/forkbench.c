@@ -0,0 +1,80 @@
+// Fork cost.  First fork+exec latency: a parent with a heap of
+// heapmb megabytes forks a child that execs straight away, as sh
+// does.  Then a fork-heavy workload after memtest: NCHILD children
+// of that parent each read their whole inherited heap and write to
+// one page in 16.  With copy-on-write fork the children share the
+// heap and copy only the pages they write, so many more of them fit
+// in memory than with copying fork.
+// Usage: forkbench [heapmb [nchild]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE  4096
+#define NFORK   200
+
+int
+main(int argc, char *argv[])
+{
+  int heapmb, nchild, i, j, n, t, sum, pid;
+  int fds[2];
+  char *heap, c;
+  char *args[] = { "forkbench", "-", 0 };
+
+  if(argc > 1 && strcmp(argv[1], "-") == 0)
+    exit();  // the exec'd child
+  heapmb = argc > 1 ? atoi(argv[1]) : 4;
+  nchild = argc > 2 ? atoi(argv[2]) : 20;
+
+  heap = sbrk(heapmb*1024*1024);
+  if(heap == (char*)-1){
+    printf(1, "forkbench: sbrk failed\n");
+    exit();
+  }
+  for(j = 0; j < heapmb*1024*1024; j += PGSIZE)
+    heap[j] = j / PGSIZE;
+
+  t = uptime();
+  for(i = 0; i < NFORK; i++){
+    if((pid = fork()) == 0){
+      exec(args[0], args);
+      printf(1, "forkbench: exec failed\n");
+      exit();
+    }
+    if(pid < 0){
+      printf(1, "forkbench: fork failed\n");
+      exit();
+    }
+    wait();
+  }
+  t = benchticks(t);
+  printf(1, "fork+exec with a %d MB heap: ", heapmb);
+  benchper(NFORK, t);
+
+  // The children hold on to their memory until the parent has
+  // forked them all, by waiting to read from a pipe.
+  pipe(fds);
+  t = uptime();
+  for(n = 0; n < nchild; n++){
+    if((pid = fork()) < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      sum = 0;
+      for(j = 0; j < heapmb*1024*1024; j += PGSIZE)
+        sum += heap[j];
+      for(j = 0; j < heapmb*1024*1024; j += 16*PGSIZE)
+        heap[j] = sum;
+      read(fds[0], &c, 1);
+      exit();
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < n; i++)
+    wait();
+  t = benchticks(t);
+  printf(1, "%d of %d children forked with a %d MB heap each, %d ticks\n",
+         n, nchild, heapmb, t);
+  exit();
+}
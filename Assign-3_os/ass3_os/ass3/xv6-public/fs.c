@@ -17,6 +17,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "rwlock.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -124,7 +125,9 @@ bfree(int dev, uint b)
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref.  Entries come from a slab cache: there
+//   are as many as are referenced, and up to NINODE free
+//   entries are kept for reuse.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
@@ -154,29 +157,32 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// The icache.lock reader-writer lock protects the allocation of
+// icache entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// Lookups of cached inodes hold it for reading and bump ip->ref
+// atomically; everything else holds it for writing.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+// It is a reader-writer lock: code that only reads the inode and
+// its content, such as path lookup, stat and exec, can lock it
+// shared with ilockread().
 
 struct {
-  struct spinlock lock;
-  struct inode inode[NINODE];
+  struct rwspinlock lock;
+  struct slabcache *cache;
+  struct inode *list;   // all entries, in use or free
+  int n;                // entries on list
 } icache;
 
 void
 iinit(int dev)
 {
-  int i = 0;
-  
-  initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  initrwlock(&icache.lock, "icache");
+  icache.cache = slabcreate("inode", sizeof(struct inode));
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -186,6 +192,8 @@ iinit(int dev)
 }
 
 static struct inode* iget(uint dev, uint inum);
+static void ipagesdrop(struct inode*);
+static void ipagesupdate(struct inode*, char*, uint, uint);
 
 //PAGEBREAK!
 // Allocate an inode on device dev.
@@ -243,21 +251,41 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&icache.lock);
+  // Is the inode already cached?  Readers cannot drop ref to 0
+  // under us, since iput() holds the lock for writing.
+  acquireread(&icache.lock);
+  for(ip = icache.list; ip; ip = ip->next){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      __sync_fetch_and_add(&ip->ref, 1);
+      releaseread(&icache.lock);
+      return ip;
+    }
+  }
+  releaseread(&icache.lock);
 
-  // Is the inode already cached?
+  // Not cached; look again, since another process may have
+  // brought it in between the two acquires.
+  acquirewrite(&icache.lock);
   empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+  for(ip = icache.list; ip; ip = ip->next){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&icache.lock);
+      releasewrite(&icache.lock);
       return ip;
     }
     if(empty == 0 && ip->ref == 0)    // Remember empty slot.
       empty = ip;
   }
 
-  // Recycle an inode cache entry.
+  // Recycle an inode cache entry, or make a new one.
+  if(empty)
+    ipagesdrop(empty);
+  else if((empty = slaballoc(icache.cache)) != 0){
+    initrwsleeplock(&empty->lock, "inode");
+    empty->next = icache.list;
+    icache.list = empty;
+    icache.n++;
+  }
   if(empty == 0)
     panic("iget: no inodes");
 
@@ -266,7 +294,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&icache.lock);
+  releasewrite(&icache.lock);
 
   return ip;
 }
@@ -276,9 +304,10 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  // The caller's reference keeps ref above 0, so readers suffice.
+  acquireread(&icache.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
+  releaseread(&icache.lock);
   return ip;
 }
 
@@ -293,7 +322,7 @@ ilock(struct inode *ip)
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
 
-  acquiresleep(&ip->lock);
+  acquirewritesleep(&ip->lock);
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -315,10 +344,36 @@ ilock(struct inode *ip)
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || !holdingwritesleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
-  releasesleep(&ip->lock);
+  releasewritesleep(&ip->lock);
+}
+
+// Lock the given inode shared with other readers, who may
+// look at it but not change it.
+void
+ilockread(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockread");
+
+  // Read it in, which needs the lock exclusively.  Once valid it
+  // stays valid while the caller's reference is held.
+  if(ip->valid == 0){
+    ilock(ip);
+    iunlock(ip);
+  }
+  acquirereadsleep(&ip->lock);
+}
+
+void
+iunlockread(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockread");
+
+  releasereadsleep(&ip->lock);
 }
 
 // Drop a reference to an in-memory inode.
@@ -331,24 +386,40 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquiresleep(&ip->lock);
-  if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
+  struct inode **pp;
+  int gone;
+
+  // Looking is enough unless the inode has to be freed.
+  acquirereadsleep(&ip->lock);
+  gone = ip->valid && ip->nlink == 0;
+  releasereadsleep(&ip->lock);
+
+  if(gone){
+    acquirewritesleep(&ip->lock);
+    acquirewrite(&icache.lock);
     int r = ip->ref;
-    release(&icache.lock);
-    if(r == 1){
+    releasewrite(&icache.lock);
+    if(r == 1 && ip->valid && ip->nlink == 0){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
       ip->valid = 0;
     }
+    releasewritesleep(&ip->lock);
   }
-  releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
-  ip->ref--;
-  release(&icache.lock);
+  acquirewrite(&icache.lock);
+  if(--ip->ref == 0 && icache.n > NINODE){
+    // Enough free entries cached already.
+    for(pp = &icache.list; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+    icache.n--;
+    ipagesdrop(ip);
+    slabfree(icache.cache, ip);
+  }
+  releasewrite(&icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -359,6 +430,113 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+// A process runs ip: execfault() reads its pages from the file as
+// they are first touched, so writes to it fail until every process
+// running it has exited or exec'd something else.  Called with ip
+// locked, or with another process's count keeping it above 0, so
+// that no write is in progress.
+void
+iexec(struct inode *ip)
+{
+  __sync_fetch_and_add(&ip->nexec, 1);
+}
+
+// A process has stopped running ip.
+void
+iexecdone(struct inode *ip)
+{
+  if(__sync_sub_and_fetch(&ip->nexec, 1) < 0)
+    panic("iexecdone");
+}
+
+// Pages of the file cached with the inode.  execfault() maps them,
+// copy-on-write, into every process running the file, so that the
+// file is read once and the processes share the memory; mmapfault()
+// does the same for mappings of any file, MAP_SHARED ones in place.
+// Writes to the file are copied into them, and they are dropped
+// when the file is truncated or the inode cache entry is reused.
+
+// Return the page holding file bytes [off, off+n) followed by
+// zeros, with a reference for the caller.  Reads it in if it is not
+// cached, unless cachedonly is set.  Caller holds ip->lock.
+char*
+ipage(struct inode *ip, uint off, uint n, int cachedonly)
+{
+  char *mem;
+  int i, free;
+
+  free = -1;
+  for(i = 0; i < NIPAGE; i++){
+    if(ip->pages[i].page && ip->pages[i].off == off && ip->pages[i].n == n){
+      kdup(ip->pages[i].page);
+      return ip->pages[i].page;
+    }
+    if(free < 0 && ip->pages[i].page == 0)
+      free = i;
+  }
+  if(cachedonly || n > PGSIZE || (mem = kalloc()) == 0)
+    return 0;
+  memset(mem + n, 0, PGSIZE - n);
+  if(readi(ip, mem, off, n) != n){
+    kfree(mem);
+    return 0;
+  }
+  if(free >= 0){
+    ip->pages[free].off = off;
+    ip->pages[free].n = n;
+    ip->pages[free].page = mem;
+    kdup(mem);
+  }
+  return mem;
+}
+
+// Copy a write of src to file bytes [off, off+n) into the cached
+// pages it overlaps, so that they stay the same as the file.  A page
+// that the write does not reach from its last file byte would be
+// left with zeros for bytes the file has, and is dropped instead.
+// Processes that have it mapped keep their references.
+static void
+ipagesupdate(struct inode *ip, char *src, uint off, uint n)
+{
+  uint lo, hi;
+  int i;
+
+  for(i = 0; i < NIPAGE; i++){
+    if(ip->pages[i].page == 0)
+      continue;
+    lo = ip->pages[i].off;
+    hi = lo + PGSIZE;
+    if(off >= hi || off + n <= lo)
+      continue;
+    if(off > lo + ip->pages[i].n){
+      kfree(ip->pages[i].page);
+      ip->pages[i].page = 0;
+      continue;
+    }
+    if(off > lo)
+      lo = off;
+    if(off + n < hi)
+      hi = off + n;
+    memmove(ip->pages[i].page + (lo - ip->pages[i].off), src + (lo - off), hi - lo);
+    if(hi - ip->pages[i].off > ip->pages[i].n)
+      ip->pages[i].n = hi - ip->pages[i].off;
+  }
+}
+
+// Processes that have the pages mapped keep their references.
+static void
+ipagesdrop(struct inode *ip)
+{
+  int i;
+
+  for(i = 0; i < NIPAGE; i++){
+    if(ip->pages[i].page){
+      kfree(ip->pages[i].page);
+      ip->pages[i].page = 0;
+    }
+  }
+}
+
 //PAGEBREAK!
 // Inode content
 //
@@ -411,6 +589,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  ipagesdrop(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -494,6 +673,9 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->nexec > 0)
+    return -1;  // text file busy
+  ipagesupdate(ip, src, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -632,21 +814,22 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockread(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockread(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockread(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+    next = dirlookup(ip, name, 0);
+    iunlockread(ip);
+    iput(ip);
+    if(next == 0)
       return 0;
-    }
-    iunlockput(ip);
     ip = next;
   }
   if(nameiparent){
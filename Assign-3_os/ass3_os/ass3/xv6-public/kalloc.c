@@ -1,6 +1,25 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and blocks of
+// 2^order physically contiguous pages for order 0..MAXORDER.
+//
+// Free memory is kept by a buddy allocator: one free list per
+// order, each block aligned to its size.  A freed block is merged
+// with its buddy, the other half of the block of the next order up,
+// for as long as the buddy is free too.
+//
+// Each CPU keeps a cache of free pages so that most calls don't
+// touch the global free list.  An empty cache is refilled with
+// KBATCH pages at once, and a cache that grows past 2*KBATCH gives
+// KBATCH back.  Only single pages go through the caches.  A cache's
+// lock is only contended when another CPU, finding the global list
+// empty too, takes a page from it.
+//
+// Pages are reference counted, so that fork can share them
+// copy-on-write: kalloc returns a page with one reference, kdup adds
+// one, and kfree drops one and frees the page with the last.  A
+// block from kallocorder is counted in its first page, and freed by
+// kfreeorder with the last reference.
 
 #include "types.h"
 #include "defs.h"
@@ -10,17 +29,32 @@
 #include "spinlock.h"
 
 void freerange(void *vstart, void *vend);
+static void buddyfree(char *v, int order);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+#define KBATCH 32  // pages moved between a CPU's cache and the free list
+
+#define FREE 0x80  // in kmem.block: page heads a free block
+
 struct run {
   struct run *next;
+  struct run *prev;  // buddy lists only
+};
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run *freelist[MAXORDER+1];  // free blocks of each order
+  uchar block[PHYSTOP/PGSIZE];       // FREE|order for a free block's first page
+  ushort ref[PHYSTOP/PGSIZE];        // references to each kalloc()ed page
+  struct kcache cpu[NCPU];
 } kmem;
 
 // Initialization happens in two phases.
@@ -31,7 +65,11 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cpu[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -43,15 +81,94 @@ kinit2(void *vstart, void *vend)
   kmem.use_lock = 1;
 }
 
+// Give [vstart, vend) to the buddy lists as the biggest aligned
+// blocks that fit.  Only the first page of each block is written,
+// so this touches a page in 2^MAXORDER rather than all of memory;
+// the rest of a page is first touched by whoever allocates it.
 void
 freerange(void *vstart, void *vend)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
-    kfree(p);
+  uint pa, pend;
+  int order;
+
+  pa = V2P(PGROUNDUP((uint)vstart));
+  pend = PGROUNDDOWN(V2P(vend));
+  while(pa < pend){
+    for(order = MAXORDER; order > 0; order--)
+      if(pa % (PGSIZE << order) == 0 && pa + (PGSIZE << order) <= pend)
+        break;
+    buddyfree(P2V(pa), order);
+    pa += PGSIZE << order;
+  }
 }
 //PAGEBREAK: 21
+// The buddy lists; callers hold kmem.lock once use_lock is set.
+static void
+buddypush(char *v, int order)
+{
+  struct run *r;
+
+  r = (struct run*)v;
+  r->prev = 0;
+  r->next = kmem.freelist[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[order] = r;
+  kmem.block[V2P(v)/PGSIZE] = FREE | order;
+}
+
+static void
+buddyunlink(struct run *r, int order)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.block[V2P(r)/PGSIZE] = 0;
+}
+
+// Free a block of 2^order pages, merging it with its buddy
+// while the buddy is free.
+static void
+buddyfree(char *v, int order)
+{
+  uint pa, b;
+
+  pa = V2P(v);
+  for(; order < MAXORDER; order++){
+    b = pa ^ (PGSIZE << order);
+    if(b >= PHYSTOP || kmem.block[b/PGSIZE] != (FREE | order))
+      break;
+    buddyunlink((struct run*)P2V(b), order);
+    pa &= ~(PGSIZE << order);
+  }
+  buddypush(P2V(pa), order);
+}
+
+// Allocate a block of 2^order pages, splitting the smallest
+// larger free block if there is none of that order.
+static char*
+buddyalloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER && kmem.freelist[k] == 0; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.freelist[k];
+  buddyunlink(r, k);
+  while(k > order){
+    // Keep the lower half, free the upper.
+    k--;
+    buddypush((char*)r + (PGSIZE << k), k);
+  }
+  return (char*)r;
+}
+
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
@@ -59,21 +176,68 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
+  struct kcache *c;
   struct run *r;
+  int i;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kfree: ref");
+  if(__sync_sub_and_fetch(&kmem.ref[V2P(v)/PGSIZE], 1) > 0)
+    return;
 
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
+  if(!kmem.use_lock){
+    buddyfree(v, 0);
+    return;
+  }
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+
+  pushcli();
+  c = &kmem.cpu[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->n > 2*KBATCH){
+    // Give KBATCH pages back to the buddy lists.
+    acquire(&kmem.lock);
+    for(i = 0; i < KBATCH; i++){
+      r = c->freelist;
+      c->freelist = r->next;
+      buddyfree((char*)r, 0);
+    }
     release(&kmem.lock);
+    c->n -= KBATCH;
+  }
+  release(&c->lock);
+  popcli();
+}
+
+// Take a page from another CPU's cache, when both this CPU's
+// cache and the buddy lists are empty.
+static struct run*
+ksteal(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  for(c = kmem.cpu; c < &kmem.cpu[NCPU]; c++){
+    acquire(&c->lock);
+    r = c->freelist;
+    if(r){
+      c->freelist = r->next;
+      c->n--;
+    }
+    release(&c->lock);
+    if(r)
+      return r;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,15 +246,128 @@ kfree(char *v)
 char*
 kalloc(void)
 {
+  struct kcache *c;
   struct run *r;
 
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    if((r = (struct run*)buddyalloc(0)) != 0)
+      kmem.ref[V2P(r)/PGSIZE] = 1;
+    return (char*)r;
+  }
+
+  pushcli();
+  c = &kmem.cpu[cpuid()];
+  acquire(&c->lock);
+  if(c->freelist == 0){
+    // Refill with up to KBATCH pages.
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
+    while(c->n < KBATCH && (r = (struct run*)buddyalloc(0)) != 0){
+      r->next = c->freelist;
+      c->freelist = r;
+      c->n++;
+    }
     release(&kmem.lock);
+  }
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  popcli();
+  if(r == 0)
+    r = ksteal();
+  if(r)
+    kmem.ref[V2P(r)/PGSIZE] = 1;
   return (char*)r;
 }
 
+// Add a reference to a page from kalloc.
+void
+kdup(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP ||
+     kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kdup");
+  __sync_fetch_and_add(&kmem.ref[V2P(v)/PGSIZE], 1);
+}
+
+// Number of references to a page from kalloc.
+int
+krefs(char *v)
+{
+  return kmem.ref[V2P(v)/PGSIZE];
+}
+
+// Give back the pages in every CPU's cache, so that they can
+// merge into larger blocks.
+static void
+kdrain(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  for(c = kmem.cpu; c < &kmem.cpu[NCPU]; c++){
+    acquire(&c->lock);
+    acquire(&kmem.lock);
+    while((r = c->freelist) != 0){
+      c->freelist = r->next;
+      buddyfree((char*)r, 0);
+    }
+    c->n = 0;
+    release(&kmem.lock);
+    release(&c->lock);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size.  Returns 0 if there is no such block free.
+char*
+kallocorder(int order)
+{
+  char *v;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  acquire(&kmem.lock);
+  v = buddyalloc(order);
+  release(&kmem.lock);
+  if(v == 0){
+    // Pages held in the caches may be what is missing.
+    kdrain();
+    acquire(&kmem.lock);
+    v = buddyalloc(order);
+    release(&kmem.lock);
+  }
+  if(v)
+    kmem.ref[V2P(v)/PGSIZE] = 1;
+  return v;
+}
+
+// Free a block from kallocorder(order).
+void
+kfreeorder(char *v, int order)
+{
+  if(order == 0){
+    kfree(v);
+    return;
+  }
+  if(order < 0 || order > MAXORDER || (uint)v % (PGSIZE << order) ||
+     v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfreeorder");
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kfreeorder: ref");
+  if(__sync_sub_and_fetch(&kmem.ref[V2P(v)/PGSIZE], 1) > 0)
+    return;
+
+#ifdef KDEBUG
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE << order);
+#endif
+
+  acquire(&kmem.lock);
+  buddyfree(v, order);
+  release(&kmem.lock);
+}
@@ -0,0 +1,42 @@
+// Page allocator throughput.  Each of n processes grows and
+// shrinks its memory with sbrk, so every page costs one kalloc and
+// one kfree; prints pages per second for n = 1 .. maxproc.
+// Run under CPUS=1 .. CPUS=8 to see how kalloc scales with CPUs.
+// Usage: kalloctest [maxproc [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE  4096
+#define NPAGES  64   // pages per sbrk
+
+void
+churn(int rounds)
+{
+  int i;
+
+  for(i = 0; i < rounds; i++){
+    if(sbrk(NPAGES*PGSIZE) == (char*)-1){
+      printf(1, "kalloctest: sbrk failed\n");
+      exit();
+    }
+    sbrk(-NPAGES*PGSIZE);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc, rounds, n, t;
+
+  maxproc = argc > 1 ? atoi(argv[1]) : 8;
+  rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+  for(n = 1; n <= maxproc; n++){
+    t = benchfork(churn, rounds, n);
+    printf(1, "%d procs: ", n);
+    benchrate((uint)n * rounds * NPAGES, "pages", t);
+  }
+  exit();
+}
@@ -0,0 +1,66 @@
+// Read-mostly kernel lookups under contention.  Each of n processes
+// stats a file two directories down, which looks up both
+// directories and the file in the inode cache and locks each inode
+// shared, and kills a pid that does not exist, which scans the
+// whole process table; prints operations per second for
+// n = 1 .. maxproc.  Run under CPUS=1 .. CPUS=8, on a kernel built
+// as usual and on one built with make NORWLOCK=1, where readers
+// take those locks exclusively.
+// Usage: lockbench [maxproc [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+void
+stats(int rounds)
+{
+  struct stat st;
+  int i;
+
+  for(i = 0; i < rounds; i++){
+    if(stat("lockbench.d/f", &st) < 0){
+      printf(1, "lockbench: stat failed\n");
+      exit();
+    }
+  }
+}
+
+void
+kills(int rounds)
+{
+  int i;
+
+  for(i = 0; i < rounds; i++)
+    kill(-1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc, rounds, n, fd;
+
+  maxproc = argc > 1 ? atoi(argv[1]) : 8;
+  rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+  mkdir("lockbench.d");
+  if((fd = open("lockbench.d/f", O_CREATE|O_RDWR)) < 0){
+    printf(1, "lockbench: create failed\n");
+    exit();
+  }
+  close(fd);
+
+  for(n = 1; n <= maxproc; n++){
+    printf(1, "stat: %d procs, ", n);
+    benchrate((uint)n * rounds, "ops", benchfork(stats, rounds, n));
+  }
+  for(n = 1; n <= maxproc; n++){
+    printf(1, "kill: %d procs, ", n);
+    benchrate((uint)n * rounds * 10, "ops", benchfork(kills, rounds * 10, n));
+  }
+
+  unlink("lockbench.d/f");
+  unlink("lockbench.d");
+  exit();
+}
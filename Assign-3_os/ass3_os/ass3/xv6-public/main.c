@@ -17,7 +17,11 @@ extern char end[]; // first address after kernel loaded from ELF file
 int
 main(void)
 {
+  uint64 t0, tkinit;
+
+  t0 = rdtsc();
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
+  tkinit = rdtsc() - t0;
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
@@ -30,10 +34,17 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  pipeinit();      // pipe buffers
+  shminit();       // shared memory segments
   ideinit();       // disk 
   startothers();   // start other processors
+  tkinit -= rdtsc();
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  tkinit += rdtsc();
   userinit();      // first user process
+  // In units of 1024 cycles, to print 64-bit counts with %d.
+  cprintf("boot: %d Kcycles, %d in kinit\n",
+          (uint)((rdtsc() - t0) >> 10), (uint)(tkinit >> 10));
   mpmain();        // finish this processor's setup
 }
 
@@ -42,6 +53,7 @@ static void
 mpenter(void)
 {
   switchkvm();
+  kvmglobal();
   seginit();
   lapicinit();
   mpmain();
@@ -0,0 +1,82 @@
+// Allocation churn: keeps NSLOT blocks live, and n times over frees
+// a random one and allocates another in its place.  Most sizes are
+// small, 8 to 512 bytes; one in 64 is a few KB and one in 1024 is
+// 128KB.  Each block is written so that overlapping blocks would
+// show up.  Reports the time, how far sbrk moved, and whether
+// freeing everything left the big blocks' memory with the kernel.
+// Usage: mallocbench [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSLOT 1000
+
+struct slot {
+  char *p;
+  uint n;
+};
+
+struct slot slots[NSLOT];
+uint seed = 1;
+
+uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+uint
+size(void)
+{
+  uint r = rand();
+
+  if(r % 1024 == 0)
+    return 128*1024;
+  if(r % 64 == 0)
+    return 1024 + r % 4096;
+  return 8 + r % 505;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, j, t, bad;
+  char *brk0;
+  struct slot *s;
+
+  n = argc > 1 ? atoi(argv[1]) : 200000;
+  brk0 = sbrk(0);
+  bad = 0;
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    s = &slots[rand() % NSLOT];
+    if(s->p){
+      if(s->p[0] != (char)s->n || s->p[s->n-1] != (char)s->n)
+        bad++;
+      free(s->p);
+    }
+    s->n = size();
+    if((s->p = malloc(s->n)) == 0){
+      printf(1, "mallocbench: malloc %d failed\n", s->n);
+      exit();
+    }
+    s->p[0] = s->p[s->n-1] = s->n;
+  }
+  benchrate(n, "malloc/free pairs", benchticks(t));
+  printf(1, "heap grew %d KB\n", (sbrk(0) - brk0) / 1024);
+
+  for(j = 0; j < NSLOT; j++){
+    free(slots[j].p);
+    slots[j].p = 0;
+  }
+  // Every block is free: a big one needs no more heap.
+  brk0 = sbrk(0);
+  free(malloc(128*1024));
+  printf(1, "after freeing all: %s, %d blocks corrupted\n",
+         sbrk(0) == brk0 ? "big block came from mmap" : "heap grew",
+         bad);
+  exit();
+}
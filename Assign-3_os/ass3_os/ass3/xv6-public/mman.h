@@ -0,0 +1,8 @@
+// mmap() protections and flags.
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+
+#define MAP_SHARED   0x01  // writes go to the file, and to children
+#define MAP_PRIVATE  0x02  // writes stay in this process
+#define MAP_ANON     0x04  // no file: zero-filled memory
+#define MAP_HUGE     0x08  // with MAP_ANON: in 4MB pages
@@ -0,0 +1,391 @@
+// Memory-mapped files and anonymous memory.
+//
+// mmap() only records a region in the process's vma[] table.
+// mmapfault() allocates each page, and reads it from the file,
+// on the first touch.  Pages of file regions come from the inode's
+// page cache (see ipage() in fs.c), so every process that maps a
+// page of the file maps the same memory: MAP_SHARED in place,
+// MAP_PRIVATE copy-on-write.  Regions are placed top-down from
+// KERNBASE, and the heap may not grow into them.  munmap(), exec
+// and exit write the pages of MAP_SHARED file regions that the
+// process dirtied back to the file.
+//
+// A child gets its parent's regions, and the pages mapped in them
+// so far; MAP_PRIVATE ones become copy-on-write.  The rest of a
+// shared file region it faults in from the page cache as it goes.
+// Anonymous MAP_SHARED regions have nothing else that holds their
+// pages, so fork maps all of them into both first.  shm.c's
+// segments use the same table.
+
+// MAP_HUGE anonymous regions are 4MB aligned and use 4MB pages
+// where memory allows, so a big region takes a handful of TLB
+// entries and no page tables.  Fork copies private ones at once.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "rwlock.h"
+#include "file.h"
+#include "mman.h"
+
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && va >= v->start && va < v->start + v->len)
+      return v;
+  return 0;
+}
+
+// Does any region overlap [va, va+n)?
+int
+mmapoverlap(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && va < v->start + v->len && v->start < va + n)
+      return 1;
+  return 0;
+}
+
+// Do regions cover all of [va, va+n)?
+int
+mmapped(struct proc *p, uint va, uint n)
+{
+  uint a;
+
+  if(va + n < va)
+    return 0;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+    if(findvma(p, a) == 0)
+      return 0;
+  return 1;
+}
+
+// Find a free slot and room for a region of len bytes, at addr
+// if it isn't 0.  Returns the slot with start and len set, or 0.
+struct vma*
+vmaalloc(struct proc *p, uint addr, uint len)
+{
+  struct vma *v, *w;
+  uint start;
+
+  len = PGROUNDUP(len);
+  if(len == 0 || len > KERNBASE || addr % PGSIZE)
+    return 0;
+  for(v = p->vma; v < &p->vma[NVMA] && v->len; v++)
+    ;
+  if(v == &p->vma[NVMA])
+    return 0;
+
+  if(addr){
+    if(addr > KERNBASE - len || mmapoverlap(p, addr, len))
+      return 0;
+    start = addr;
+  } else {
+    // The highest free range, either just below KERNBASE or
+    // just below another region.
+    start = 0;
+    if(!mmapoverlap(p, KERNBASE - len, len))
+      start = KERNBASE - len;
+    for(w = p->vma; w < &p->vma[NVMA]; w++)
+      if(w->len && w->start >= len && w->start - len > start &&
+         !mmapoverlap(p, w->start - len, len))
+        start = w->start - len;
+  }
+  if(start < PGROUNDUP(p->sz))
+    return 0;
+
+  memset(v, 0, sizeof(*v));
+  v->start = start;
+  v->len = len;
+  return v;
+}
+
+// Map len bytes of f from off, or anonymous memory if f is 0.
+// Returns the address, or -1.
+int
+mmap(uint len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint a;
+
+  a = 0;
+  if(flags & MAP_HUGE){
+    // 4MB aligned, as high as there is room.
+    len = BIGPGROUNDUP(len);
+    if(len == 0 || len > KERNBASE)
+      return -1;
+    for(a = KERNBASE - len; mmapoverlap(p, a, len); a -= BIGPGSIZE)
+      if(a < BIGPGSIZE)
+        return -1;
+    if(a < PGROUNDUP(p->sz))
+      return -1;
+  }
+  if((v = vmaalloc(p, a, len)) == 0)
+    return -1;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  return v->start;
+}
+
+// Write back one page of a shared region, no further than the
+// end of the file, in transactions no bigger than filewrite's.
+static void
+writeback(struct file *f, char *page, uint off)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint i, m;
+
+  for(i = 0; i < PGSIZE; i += m){
+    begin_op();
+    ilock(f->ip);
+    m = 0;
+    if(off + i < f->ip->size){
+      m = f->ip->size - (off + i);
+      if(m > PGSIZE - i)
+        m = PGSIZE - i;
+      if(m > max)
+        m = max;
+      writei(f->ip, page + i, off + i, m);
+    }
+    iunlock(f->ip);
+    end_op();
+    if(m == 0)
+      break;
+  }
+}
+
+// Unmap [va, va+n) of region v.
+static void
+unmappages(struct proc *p, struct vma *v, uint va, uint n)
+{
+  pde_t *pde;
+  pte_t *pte;
+  uint a, pa;
+
+  for(a = va; a < va + n; a += PGSIZE){
+    pde = &p->pgdir[PDX(a)];
+    if(*pde & PTE_PS){
+      // A 4MB page of a MAP_HUGE region, which munmap keeps whole.
+      kfreeorder(P2V(PTE_ADDR(*pde)), BIGPGORDER);
+      *pde = 0;
+      a += BIGPGSIZE - PGSIZE;
+      continue;
+    }
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || (*pte & PTE_P) == 0)
+      continue;
+    pa = PTE_ADDR(*pte);
+    if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_D))
+      writeback(v->f, P2V(pa), v->off + (a - v->start));
+    *pte = 0;
+    kfree(P2V(pa));
+  }
+  if(p == myproc())
+    lcr3(V2P(p->pgdir));
+}
+
+// Unmap the pages in [addr, addr+len), which must lie in one
+// region, and all of it if it is a shared memory segment.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *w;
+
+  len = PGROUNDUP(len);
+  if(addr % PGSIZE || len == 0 || addr + len < addr)
+    return -1;
+  if((v = findvma(p, addr)) == 0 || addr + len > v->start + v->len)
+    return -1;
+  if(v->shm && (addr != v->start || len != v->len))
+    return -1;
+  if((v->flags & MAP_HUGE) && (addr % BIGPGSIZE || len % BIGPGSIZE))
+    return -1;
+
+  w = 0;
+  if(addr > v->start && addr + len < v->start + v->len){
+    // A hole in the middle: the part after it becomes a region.
+    for(w = p->vma; w < &p->vma[NVMA] && w->len; w++)
+      ;
+    if(w == &p->vma[NVMA])
+      return -1;
+  }
+
+  unmappages(p, v, addr, len);
+  if(w){
+    *w = *v;
+    w->start = addr + len;
+    w->len = v->start + v->len - w->start;
+    w->off = v->off + (w->start - v->start);
+    if(w->f)
+      filedup(w->f);
+    v->len = addr - v->start;
+  } else if(len == v->len){
+    if(v->f)
+      fileclose(v->f);
+    if(v->shm)
+      shmput(v->shm);
+    v->f = 0;
+    v->shm = 0;
+    v->len = 0;
+  } else if(addr == v->start){
+    v->start += len;
+    v->off += len;
+    v->len -= len;
+  } else
+    v->len -= len;
+  return 0;
+}
+
+// Unmap all regions, for exec and exit.
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    unmappages(p, v, v->start, v->len);
+    if(v->f)
+      fileclose(v->f);
+    if(v->shm)
+      shmput(v->shm);
+    v->f = 0;
+    v->shm = 0;
+    v->len = 0;
+  }
+}
+
+// Read in the page at va of a region.  Returns -1 if va is
+// in no region, or if memory is out.  Shared memory segments
+// are mapped whole when attached, so never fault.
+int
+mmapfault(struct proc *p, uint va)
+{
+  struct vma *v;
+  struct inode *ip;
+  uint a, off, n, perm;
+  char *mem;
+
+  if((v = findvma(p, va)) == 0 || v->shm)
+    return -1;
+  if((v->flags & MAP_HUGE) && (p->pgdir[PDX(va)] & PTE_P) == 0 &&
+     (mem = kallocorder(BIGPGORDER)) != 0){
+    // A whole 4MB page.  With none to spare, or a page table from
+    // earlier mappings in the way, 4KB pages will do.
+    memset(mem, 0, BIGPGSIZE);
+    p->pgdir[PDX(va)] = V2P(mem) | PTE_P | PTE_U | PTE_PS |
+                        ((v->prot & PROT_WRITE) ? PTE_W : 0);
+    return 0;
+  }
+  a = PGROUNDDOWN(va);
+  perm = PTE_U | ((v->prot & PROT_WRITE) ? PTE_W : 0);
+  mem = 0;
+  if(v->f){
+    // The inode's cached copy of the page: only the first mapping
+    // of a page of the file copies it out of the buffer cache.
+    ip = v->f->ip;
+    off = v->off + (a - v->start);
+    ilock(ip);
+    if(off < ip->size){
+      n = ip->size - off;
+      if(n > PGSIZE)
+        n = PGSIZE;
+      if((mem = ipage(ip, off, n, 0)) == 0){
+        iunlock(ip);
+        return -1;
+      }
+      if(v->flags & MAP_PRIVATE)
+        perm = PTE_U | ((v->prot & PROT_WRITE) ? PTE_COW : 0);
+    }
+    iunlock(ip);
+  }
+  if(mem == 0){
+    // Anonymous, or past the end of the file, which reads as zeros.
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+  }
+  if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Give child the parent's regions, for fork.
+int
+mmapfork(struct proc *parent, struct proc *child)
+{
+  struct vma *v;
+  pde_t *pde;
+  pte_t *pte;
+  char *mem;
+  uint a;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &parent->vma[i];
+    child->vma[i] = *v;
+    if(v->len == 0)
+      continue;
+    if(v->f)
+      filedup(v->f);
+    if(v->shm)
+      shmdup(v->shm);
+    // Both must get the same anonymous pages, including the ones
+    // not touched yet, or each would fault in a zeroed page of its
+    // own.  A file's are found again in the page cache.
+    if((v->flags & MAP_SHARED) && v->f == 0 &&
+       pagein(parent, v->start, v->len, 0) < 0)
+      goto bad;
+    for(a = v->start; a < v->start + v->len; a += PGSIZE){
+      pde = &parent->pgdir[PDX(a)];
+      if(*pde & PTE_PS){
+        // A 4MB page: shared, or copied now.
+        mem = P2V(PTE_ADDR(*pde));
+        if(v->flags & MAP_SHARED)
+          kdup(mem);
+        else if((mem = kallocorder(BIGPGORDER)) != 0)
+          memmove(mem, P2V(PTE_ADDR(*pde)), BIGPGSIZE);
+        else
+          goto bad;
+        child->pgdir[PDX(a)] = V2P(mem) | (PTE_FLAGS(*pde) & ~PTE_D);
+        a += BIGPGSIZE - PGSIZE;
+        continue;
+      }
+      if((pte = walkpgdir(parent->pgdir, (char*)a, 0)) == 0 || (*pte & PTE_P) == 0)
+        continue;
+      if((v->flags & MAP_PRIVATE) && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      if(mappages(child->pgdir, (char*)a, PGSIZE, PTE_ADDR(*pte),
+                  PTE_FLAGS(*pte) & ~(PTE_P|PTE_D)) < 0)
+        goto bad;
+      kdup(P2V(PTE_ADDR(*pte)));
+    }
+  }
+  lcr3(V2P(parent->pgdir));
+  return 0;
+
+bad:
+  lcr3(V2P(parent->pgdir));
+  for(i++; i < NVMA; i++)
+    child->vma[i].len = 0;
+  munmapall(child);
+  return -1;
+}
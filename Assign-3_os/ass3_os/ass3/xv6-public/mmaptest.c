@@ -0,0 +1,182 @@
+// mmap checks and a scan benchmark.  Checks that writes through a
+// shared file mapping reach the file, that writes through a private
+// one don't, that a shared region is shared with a child even where
+// only the child touched it, that two shared mappings of a file and
+// write() see the same page, and that read() into a read-only
+// mapping fails rather than faulting in the kernel.  Then sums a
+// FILESZ-byte file n times: with read() into a buffer, with a fresh
+// private mmap each pass, which faults each pass but maps the
+// inode's cached pages rather than copying, and through one mapping
+// kept across passes, which faults only once.  The first mapping of
+// each page still copies it out of the buffer cache.
+// Usage: mmaptest [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define FILESZ  (32*1024)
+#define PGSIZE  4096
+
+char buf[512];
+
+void
+fail(char *what)
+{
+  printf(1, "mmaptest: %s failed\n", what);
+  unlink("mmapdata");
+  exit();
+}
+
+int
+sum(char *p, int n)
+{
+  int i, s;
+
+  s = 0;
+  for(i = 0; i < n; i++)
+    s += p[i];
+  return s;
+}
+
+void
+check(void)
+{
+  int fd, pid, pfd[2];
+  char *p, *q;
+
+  fd = open("mmapdata", O_RDWR);
+  p = mmap(0, FILESZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap shared");
+  p[0] = 'S';
+  p[FILESZ-1] = 'E';
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap");
+  p = mmap(0, FILESZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap private");
+  if(p[0] != 'S' || p[FILESZ-1] != 'E')
+    fail("shared write");
+  p[0] = 'P';
+  munmap(p, FILESZ);
+  if(read(fd, buf, 1) != 1 || buf[0] != 'S')
+    fail("private write");
+  close(fd);
+
+  // Pages first touched after the fork, in the child.
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+  if(p == (char*)-1)
+    fail("mmap anonymous");
+  if((pid = fork()) == 0){
+    p[100] = 'C';
+    exit();
+  }
+  wait();
+  if(p[0] != 0)
+    fail("zero fill");
+  if(p[100] != 'C')
+    fail("shared anonymous");
+  munmap(p, PGSIZE);
+  fd = open("mmapdata", O_RDWR);
+  p = mmap(0, FILESZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == (char*)-1)
+    fail("mmap shared");
+  if((pid = fork()) == 0){
+    p[PGSIZE] = 'K';
+    exit();
+  }
+  wait();
+  if(p[PGSIZE] != 'K')
+    fail("shared file page touched in child");
+
+  // A second mapping of the file, and write(), see the first's
+  // page at once: they share the inode's cached copy.
+  fd = open("mmapdata", O_RDWR);
+  q = mmap(0, FILESZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(q == (char*)-1)
+    fail("mmap shared again");
+  p[PGSIZE+1] = 'M';
+  if(q[PGSIZE+1] != 'M')
+    fail("shared page cache");
+  if(p[0] != 'S')
+    fail("shared write");
+  write(fd, "W", 1);
+  if(p[0] != 'W' || q[0] != 'W')
+    fail("write to a mapped page");
+  close(fd);
+  munmap(q, FILESZ);
+  munmap(p, FILESZ);
+
+  p = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE|MAP_ANON, -1, 0);
+  if(p == (char*)-1)
+    fail("mmap read-only");
+  fd = open("mmapdata", O_RDONLY);
+  if(read(fd, p, 10) != -1)
+    fail("read into read-only mapping");
+  close(fd);
+  pipe(pfd);
+  write(pfd[1], "x", 1);
+  if(read(pfd[0], p, 1) != -1)
+    fail("pipe read into read-only mapping");
+  close(pfd[0]);
+  close(pfd[1]);
+  munmap(p, PGSIZE);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, fd, i, j, t;
+  volatile int s;
+  char *p;
+
+  n = argc > 1 ? atoi(argv[1]) : 100;
+  if((fd = open("mmapdata", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  for(i = 0; i < FILESZ; i += sizeof(buf))
+    write(fd, buf, sizeof(buf));
+  close(fd);
+
+  check();
+
+  fd = open("mmapdata", O_RDONLY);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    s = 0;
+    close(fd);
+    fd = open("mmapdata", O_RDONLY);
+    while((j = read(fd, buf, sizeof(buf))) > 0)
+      s += sum(buf, j);
+  }
+  printf(1, "read:          ");
+  benchper(n, benchticks(t));
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if((p = mmap(0, FILESZ, PROT_READ, MAP_PRIVATE, fd, 0)) == (char*)-1)
+      fail("mmap");
+    s = sum(p, FILESZ);
+    munmap(p, FILESZ);
+  }
+  printf(1, "mmap per pass: ");
+  benchper(n, benchticks(t));
+
+  t = uptime();
+  if((p = mmap(0, FILESZ, PROT_READ, MAP_PRIVATE, fd, 0)) == (char*)-1)
+    fail("mmap");
+  for(i = 0; i < n; i++)
+    s = sum(p, FILESZ);
+  munmap(p, FILESZ);
+  printf(1, "mmap once:     ");
+  benchper(n, benchticks(t));
+
+  close(fd);
+  unlink("mmapdata");
+  exit();
+}
@@ -6,9 +6,12 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "rwlock.h"
 
+// Code that only looks at the table holds ptable.lock for
+// reading; anything that changes it holds it for writing.
 struct {
-  struct spinlock lock;
+  struct rwspinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
@@ -18,12 +21,13 @@ int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
+static void sleep1(void *chan);
 static void wakeup1(void *chan);
 
 void
 pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
+  initrwlock(&ptable.lock, "ptable");
 }
 
 // Must be called with interrupts disabled
@@ -76,20 +80,20 @@ allocproc(void)
   struct proc *p;
   char *sp;
 
-  acquire(&ptable.lock);
+  acquirewrite(&ptable.lock);
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == UNUSED)
       goto found;
 
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
   return 0;
 
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
 
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
@@ -146,11 +150,11 @@ userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquirewrite(&ptable.lock);
 
   p->state = RUNNABLE;
 
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
@@ -163,6 +167,8 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
+    if(mmapoverlap(curproc, sz, n))
+      return -1;
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
@@ -190,7 +196,10 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0 ||
+     mmapfork(curproc, np) < 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -207,16 +216,22 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->exe){
+    np->exe = idup(curproc->exe);
+    iexec(np->exe);
+  }
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
+  np->nseg = curproc->nseg;
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
+  acquirewrite(&ptable.lock);
 
   np->state = RUNNABLE;
 
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
 
   return pid;
 }
@@ -234,7 +249,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
+  // Write back and unmap mmap regions, and close all open files.
+  munmapall(curproc);
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
       fileclose(curproc->ofile[fd]);
@@ -244,10 +260,15 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe){
+    iexecdone(curproc->exe);
+    iput(curproc->exe);
+  }
+  curproc->exe = 0;
   end_op();
   curproc->cwd = 0;
 
-  acquire(&ptable.lock);
+  acquirewrite(&ptable.lock);
 
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
@@ -276,7 +297,7 @@ wait(void)
   int havekids, pid;
   struct proc *curproc = myproc();
   
-  acquire(&ptable.lock);
+  acquirewrite(&ptable.lock);
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
@@ -295,19 +316,19 @@ wait(void)
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
-        release(&ptable.lock);
+        releasewrite(&ptable.lock);
         return pid;
       }
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || curproc->killed){
-      release(&ptable.lock);
+      releasewrite(&ptable.lock);
       return -1;
     }
 
     // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+    sleep1(curproc);  //DOC: wait-sleep
   }
 }
 
@@ -330,8 +351,18 @@ scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
+    // Look for a process to run with the table shared, so that
+    // idle CPUs don't hold off each other, kill() or procdump().
+    acquireread(&ptable.lock);
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if(p->state == RUNNABLE)
+        break;
+    releaseread(&ptable.lock);
+    if(p == &ptable.proc[NPROC])
+      continue;
+
     // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
+    acquirewrite(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
@@ -350,7 +381,7 @@ scheduler(void)
       // It should have changed its p->state before coming back.
       c->proc = 0;
     }
-    release(&ptable.lock);
+    releasewrite(&ptable.lock);
 
   }
 }
@@ -368,7 +399,7 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
+  if(!holdingwrite(&ptable.lock))
     panic("sched ptable.lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
@@ -385,10 +416,10 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
+  acquirewrite(&ptable.lock);  //DOC: yieldlock
   myproc()->state = RUNNABLE;
   sched();
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -398,7 +429,7 @@ forkret(void)
 {
   static int first = 1;
   // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -431,10 +462,23 @@ sleep(void *chan, struct spinlock *lk)
   // guaranteed that we won't miss any wakeup
   // (wakeup runs with ptable.lock locked),
   // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
+  acquirewrite(&ptable.lock);  //DOC: sleeplock1
+  release(lk);
+
+  sleep1(chan);
+
+  // Reacquire original lock.
+  releasewrite(&ptable.lock);  //DOC: sleeplock2
+  acquire(lk);
+}
+
+// Sleep on chan with ptable.lock, which the caller holds for
+// writing, as the lock; for wait().
+static void
+sleep1(void *chan)
+{
+  struct proc *p = myproc();
+
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
@@ -443,12 +487,6 @@ sleep(void *chan, struct spinlock *lk)
 
   // Tidy up.
   p->chan = 0;
-
-  // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
 }
 
 //PAGEBREAK!
@@ -468,9 +506,9 @@ wakeup1(void *chan)
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
+  acquirewrite(&ptable.lock);
   wakeup1(chan);
-  release(&ptable.lock);
+  releasewrite(&ptable.lock);
 }
 
 // Kill the process with the given pid.
@@ -480,26 +518,38 @@ int
 kill(int pid)
 {
   struct proc *p;
+  int asleep;
 
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  // Finding the process and marking it only need the table shared.
+  acquireread(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid)
+      break;
+  if(p == &ptable.proc[NPROC]){
+    releaseread(&ptable.lock);
+    return -1;
+  }
+  p->killed = 1;
+  asleep = p->state == SLEEPING;
+  releaseread(&ptable.lock);
+
+  // Wake process from sleep if necessary.  It may have woken or
+  // exited since, so look again.
+  if(asleep){
+    acquirewrite(&ptable.lock);
+    if(p->pid == pid && p->state == SLEEPING)
+      p->state = RUNNABLE;
+    releasewrite(&ptable.lock);
   }
-  release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
+// Copies each entry with the table held for reading, and prints
+// it after letting go: cprintf takes cons.lock, which is held
+// around sleep() and wakeup() and so taken before ptable.lock.
 void
 procdump(void)
 {
@@ -511,24 +561,31 @@ procdump(void)
   [RUNNING]   "run   ",
   [ZOMBIE]    "zombie"
   };
-  int i;
+  int i, pid;
   struct proc *p;
-  char *state;
+  enum procstate st;
+  char *state, name[16];
   uint pc[10];
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED)
+    acquireread(&ptable.lock);
+    st = p->state;
+    pid = p->pid;
+    safestrcpy(name, p->name, sizeof(name));
+    pc[0] = 0;
+    if(st == SLEEPING)
+      getcallerpcs((uint*)p->context->ebp+2, pc);
+    releaseread(&ptable.lock);
+
+    if(st == UNUSED)
       continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
+    if(st >= 0 && st < NELEM(states) && states[st])
+      state = states[st];
     else
       state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
-    if(p->state == SLEEPING){
-      getcallerpcs((uint*)p->context->ebp+2, pc);
-      for(i=0; i<10 && pc[i] != 0; i++)
-        cprintf(" %p", pc[i]);
-    }
+    cprintf("%d %s %s", pid, state, name);
+    for(i=0; i<10 && pc[i] != 0; i++)
+      cprintf(" %p", pc[i]);
     cprintf("\n");
   }
 }
@@ -34,6 +34,26 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A loadable segment of a process's executable.  exec leaves its
+// pages unmapped, and execfault() reads them in on first touch.
+struct execseg {
+  uint va;                     // First address, page aligned
+  uint memsz;                  // Size in memory
+  uint off;                    // Offset in the file
+  uint filesz;                 // Bytes from the file; the rest is zero
+};
+
+// A region made by mmap().
+struct vma {
+  uint start;                  // First address, page aligned
+  uint len;                    // Length, page aligned; 0 if unused
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE, MAP_ANON
+  struct file *f;              // Mapped file, or 0
+  struct shm *shm;             // Attached shared memory segment, or 0
+  uint off;                    // Offset in the file of start
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -48,6 +68,10 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Executable, for execfault()
+  struct execseg seg[NSEG];    // Its loadable segments
+  int nseg;
+  struct vma vma[NVMA];        // Memory-mapped regions
   char name[16];               // Process name (debugging)
 };
 
@@ -0,0 +1,175 @@
+// Reader-writer locks.
+//
+// Built with NORWLOCK defined (make NORWLOCK=1), readers take the
+// locks exclusively, as plain locks would, so that lockbench can
+// compare the two.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwspinlock *lk, char *name)
+{
+  lk->name = name;
+  lk->cnt = 0;
+  lk->wwait = 0;
+  lk->cpu = 0;
+}
+
+// Acquire the lock shared with other readers.
+// Like acquire(), keeps interrupts off while held.
+void
+acquireread(struct rwspinlock *lk)
+{
+  int c;
+
+#ifdef NORWLOCK
+  acquirewrite(lk);
+  return;
+#endif
+  pushcli();
+  if(lk->cpu == mycpu())
+    panic("acquireread");
+
+  for(;;){
+    c = lk->cnt;
+    if(c >= 0 && lk->wwait == 0 && __sync_bool_compare_and_swap(&lk->cnt, c, c+1))
+      break;
+  }
+  // The locked cmpxchg is a full barrier, as xchg is in acquire().
+}
+
+void
+releaseread(struct rwspinlock *lk)
+{
+#ifdef NORWLOCK
+  releasewrite(lk);
+  return;
+#endif
+  if(lk->cnt <= 0)
+    panic("releaseread");
+  __sync_fetch_and_sub(&lk->cnt, 1);
+  popcli();
+}
+
+// Acquire the lock exclusively.
+void
+acquirewrite(struct rwspinlock *lk)
+{
+  pushcli();
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+
+  __sync_fetch_and_add(&lk->wwait, 1);
+  while(!__sync_bool_compare_and_swap(&lk->cnt, 0, -1))
+    ;
+  __sync_fetch_and_sub(&lk->wwait, 1);
+  lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwspinlock *lk)
+{
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+
+  lk->cpu = 0;
+  __sync_synchronize();
+  asm volatile("movl $0, %0" : "+m" (lk->cnt) : );
+  popcli();
+}
+
+// Check whether this cpu is holding the lock for writing.
+int
+holdingwrite(struct rwspinlock *lk)
+{
+  int r;
+  pushcli();
+  r = lk->cnt == -1 && lk->cpu == mycpu();
+  popcli();
+  return r;
+}
+
+//PAGEBREAK!
+void
+initrwsleeplock(struct rwsleeplock *lk, char *name)
+{
+  initlock(&lk->lk, "rw sleep lock");
+  lk->name = name;
+  lk->readers = 0;
+  lk->writer = 0;
+  lk->wwait = 0;
+  lk->pid = 0;
+}
+
+void
+acquirereadsleep(struct rwsleeplock *lk)
+{
+#ifdef NORWLOCK
+  acquirewritesleep(lk);
+  return;
+#endif
+  acquire(&lk->lk);
+  while (lk->writer || lk->wwait) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasereadsleep(struct rwsleeplock *lk)
+{
+#ifdef NORWLOCK
+  releasewritesleep(lk);
+  return;
+#endif
+  acquire(&lk->lk);
+  if(lk->readers <= 0)
+    panic("releasereadsleep");
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+void
+acquirewritesleep(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->wwait++;
+  while (lk->writer || lk->readers) {
+    sleep(lk, &lk->lk);
+  }
+  lk->wwait--;
+  lk->writer = 1;
+  lk->pid = myproc()->pid;
+  release(&lk->lk);
+}
+
+void
+releasewritesleep(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->writer = 0;
+  lk->pid = 0;
+  wakeup(lk);
+  release(&lk->lk);
+}
+
+int
+holdingwritesleep(struct rwsleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = lk->writer && (lk->pid == myproc()->pid);
+  release(&lk->lk);
+  return r;
+}
@@ -0,0 +1,24 @@
+// Reader-writer spin lock: any number of readers, or one writer.
+// A waiting writer holds off new readers so it cannot starve.
+// Not recursive: a reader must not re-acquire for reading.
+struct rwspinlock {
+  int cnt;           // Readers holding the lock, or -1 if a writer does.
+  uint wwait;        // Writers waiting to acquire.
+
+  // For debugging:
+  char *name;        // Name of lock.
+  struct cpu *cpu;   // The cpu holding the lock for writing.
+};
+
+// Long-term reader-writer lock for processes.
+struct rwsleeplock {
+  int readers;       // Number of readers holding the lock.
+  int writer;        // Is the lock held for writing?
+  int wwait;         // Writers sleeping on the lock.
+  struct spinlock lk; // spinlock protecting this sleep lock
+
+  // For debugging:
+  char *name;        // Name of lock.
+  int pid;           // Process holding lock for writing
+};
+
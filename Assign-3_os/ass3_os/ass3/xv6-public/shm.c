@@ -0,0 +1,184 @@
+// Shared memory segments.
+//
+// shmget() finds or makes a segment by key, allocating and zeroing
+// all of its pages.  shmat() maps those pages into the process at
+// a free address or one it chose, as a region in the vma[] table
+// of mmap.c; munmap, exec and exit detach it, and fork gives the
+// child the attachment too.  Each attachment holds a reference to
+// every page, and the segment holds one more until it has been
+// removed with shmrm() and the last process has detached.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "mman.h"
+
+struct shm {
+  int key;        // 0 for a private segment
+  int ref;        // attachments
+  int removed;    // shmrm was called
+  uint npages;    // 0 if the slot is free
+  char *pages[SHMPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Free a segment's pages.  Called with shmtab.lock held.
+static void
+shmfree(struct shm *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  s->npages = 0;
+}
+
+// Return the id of the segment with key, making one of size bytes
+// if there is none.  A key of 0 always makes a new segment.
+// Returns -1 if the segment is smaller than size, or if there is no
+// room for a new one.
+int
+shmget(int key, uint size)
+{
+  struct shm *s, *free;
+  uint n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(n == 0 || n > SHMPAGES)
+    return -1;
+  acquire(&shmtab.lock);
+  free = 0;
+  for(s = shmtab.shm; s < &shmtab.shm[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+    } else if(key != 0 && s->key == key && !s->removed){
+      release(&shmtab.lock);
+      return s->npages >= n ? s - shmtab.shm : -1;
+    }
+  }
+  if((s = free) == 0){
+    release(&shmtab.lock);
+    return -1;
+  }
+  for(s->npages = 0; s->npages < n; s->npages++){
+    if((s->pages[s->npages] = kalloc()) == 0){
+      shmfree(s);
+      release(&shmtab.lock);
+      return -1;
+    }
+    memset(s->pages[s->npages], 0, PGSIZE);
+  }
+  s->key = key;
+  s->ref = 0;
+  s->removed = 0;
+  release(&shmtab.lock);
+  return s - shmtab.shm;
+}
+
+// Attach segment id at addr, or wherever there is room if addr is
+// 0.  Returns the address, or -1.
+int
+shmat(int id, uint addr)
+{
+  struct proc *p = myproc();
+  struct shm *s;
+  struct vma *v;
+  int i;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtab.shm[id];
+  acquire(&shmtab.lock);
+  if(s->npages == 0 || s->removed){
+    release(&shmtab.lock);
+    return -1;
+  }
+  s->ref++;
+  release(&shmtab.lock);
+
+  if((v = vmaalloc(p, addr, s->npages*PGSIZE)) == 0){
+    shmput(s);
+    return -1;
+  }
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_SHARED;
+  v->shm = s;
+  for(i = 0; i < s->npages; i++){
+    if(mappages(p->pgdir, (char*)v->start + i*PGSIZE, PGSIZE,
+                V2P(s->pages[i]), PTE_W|PTE_U) < 0){
+      munmap(v->start, v->len);  // skips the pages not yet mapped
+      return -1;
+    }
+    kdup(s->pages[i]);
+  }
+  return v->start;
+}
+
+// Detach the segment attached at addr.
+int
+shmdt(uint addr)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && v->shm && v->start == addr)
+      return munmap(addr, v->len);
+  return -1;
+}
+
+// Remove segment id once the last process detaches.
+// Its key may be used for a new segment straight away.
+int
+shmrm(int id)
+{
+  struct shm *s;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtab.shm[id];
+  acquire(&shmtab.lock);
+  if(s->npages == 0 || s->removed){
+    release(&shmtab.lock);
+    return -1;
+  }
+  s->removed = 1;
+  if(s->ref == 0)
+    shmfree(s);
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Another attachment, for fork.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  s->ref++;
+  release(&shmtab.lock);
+}
+
+// Drop an attachment.
+void
+shmput(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(--s->ref == 0 && s->removed)
+    shmfree(s);
+  release(&shmtab.lock);
+}
@@ -0,0 +1,163 @@
+// Producer/consumer throughput: the producer makes mb megabytes in
+// 4KB chunks and the consumer sums them, first through a pipe and
+// then through a ring of NSLOT chunks in a shared memory segment.
+// The consumer execs this program again, so the two processes are
+// unrelated and find the segment by its key.  With the pipe every
+// byte is copied into the kernel and out again, 512 at a time;
+// with the segment the producer writes each chunk in place.
+// Waiting on the ring spins for a while and then sleeps a tick,
+// so run it with CPUS=2 or more.
+// Usage: shmbench [mb]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE  4096
+#define NSLOT   16
+#define SPINS   100000
+#define KEY     0x5348
+
+// The first page of the segment; the slots follow it.
+struct ring {
+  volatile uint head;   // chunks produced
+  volatile uint tail;   // chunks consumed
+  volatile uint sum;    // consumer's total
+};
+
+char buf[PGSIZE];
+
+void
+fill(char *p, uint n)
+{
+  int i;
+
+  for(i = 0; i < PGSIZE; i++)
+    p[i] = n + i;
+}
+
+uint
+sum(char *p)
+{
+  uint s;
+  int i;
+
+  s = 0;
+  for(i = 0; i < PGSIZE; i++)
+    s += (uchar)p[i];
+  return s;
+}
+
+void
+wait1(int *spins)
+{
+  if(++*spins < SPINS)
+    return;
+  sleep(1);
+  *spins = 0;
+}
+
+void
+consumer(int n)
+{
+  struct ring *r;
+  char *slots;
+  uint s, i;
+  int id, spins;
+
+  if((id = shmget(KEY, (NSLOT+1)*PGSIZE)) < 0 ||
+     (r = shmat(id, 0)) == (struct ring*)-1){
+    printf(1, "shmbench: consumer can't attach\n");
+    exit();
+  }
+  slots = (char*)r + PGSIZE;
+  s = 0;
+  for(i = 0; i < n; i++){
+    spins = 0;
+    while(r->head == i)
+      wait1(&spins);
+    __sync_synchronize();
+    s += sum(slots + (i%NSLOT)*PGSIZE);
+    __sync_synchronize();
+    r->tail = i + 1;
+  }
+  r->sum = s;
+  shmdt(r);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *args[] = { "shmbench", "-", "4", 0 };
+  int fds[2];
+  int mb, n, i, t, id, spins;
+  uint s, want;
+  struct ring *r;
+  char *slots;
+
+  if(argc > 2 && strcmp(argv[1], "-") == 0){
+    consumer(atoi(argv[2]) * 1024*1024 / PGSIZE);
+    exit();
+  }
+  if(argc > 1)
+    args[2] = argv[1];
+  mb = atoi(args[2]);
+  n = mb * 1024*1024 / PGSIZE;
+  want = 0;
+  for(i = 0; i < n; i++){
+    fill(buf, i);
+    want += sum(buf);
+  }
+
+  pipe(fds);
+  t = uptime();
+  if(fork() == 0){
+    close(fds[1]);
+    s = 0;
+    while((i = read(fds[0], buf, PGSIZE)) > 0){
+      // Chunks may come in pieces; sum what came.
+      for(i--; i >= 0; i--)
+        s += (uchar)buf[i];
+    }
+    printf(1, "pipe: consumer sum %s\n", s == want ? "ok" : "wrong");
+    exit();
+  }
+  close(fds[0]);
+  for(i = 0; i < n; i++){
+    fill(buf, i);
+    write(fds[1], buf, PGSIZE);
+  }
+  close(fds[1]);
+  wait();
+  printf(1, "pipe: ");
+  benchrate(mb, "MB", benchticks(t));
+
+  if((id = shmget(KEY, (NSLOT+1)*PGSIZE)) < 0 ||
+     (r = shmat(id, 0)) == (struct ring*)-1){
+    printf(1, "shmbench: shmget/shmat failed\n");
+    exit();
+  }
+  slots = (char*)r + PGSIZE;
+  t = uptime();
+  if(fork() == 0){
+    exec(args[0], args);
+    printf(1, "shmbench: exec failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    spins = 0;
+    while(r->head - r->tail == NSLOT)
+      wait1(&spins);
+    fill(slots + (i%NSLOT)*PGSIZE, i);
+    __sync_synchronize();
+    r->head = i + 1;
+  }
+  wait();
+  t = benchticks(t);
+  printf(1, "shm: consumer sum %s\n", r->sum == want ? "ok" : "wrong");
+  printf(1, "shm:  ");
+  benchrate(mb, "MB", t);
+  shmdt(r);
+  shmrm(id);
+  exit();
+}
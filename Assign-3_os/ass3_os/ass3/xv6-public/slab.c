@@ -0,0 +1,177 @@
+// Slab allocator for small kernel objects.
+//
+// A slab cache hands out objects of one size.  The objects are
+// carved out of pages (slabs) that start with a struct slab header,
+// and a free object is linked into its slab's free list through its
+// first word, so the slab an object belongs to is just the page it
+// is in.  Slabs with free objects are on the cache's list, full
+// slabs are on no list, and a slab whose objects are all free goes
+// back to kalloc unless it is the only one on the list.
+//
+// In front of the slabs each CPU has a magazine of up to MAGSIZE
+// free objects, used with interrupts off and no lock.  An empty
+// magazine is refilled with MAGSIZE/2 objects under the cache's
+// lock, and a full one gives MAGSIZE/2 back.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+
+#define NSLABCACHE 16
+#define MAGSIZE    16
+
+struct slab {
+  struct slab *next;    // on the cache's list of slabs with free objects
+  struct slab *prev;
+  struct slabcache *cache;
+  int inuse;            // objects handed out
+  char *free;           // free objects
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;            // bytes per object
+  int perslab;          // objects per slab
+  struct slab *slabs;   // slabs with free objects
+  struct {
+    int n;
+    char *obj[MAGSIZE];
+  } mag[NCPU];
+};
+
+struct {
+  struct slabcache cache[NSLABCACHE];
+  int n;
+} slabs;
+
+// Make a cache for objects of size bytes.
+// Called only while booting, so needs no lock.
+struct slabcache*
+slabcreate(char *name, uint size)
+{
+  struct slabcache *c;
+
+  size = (size + 7) & ~7;
+  if(size == 0 || size > PGSIZE - sizeof(struct slab) || slabs.n == NSLABCACHE)
+    panic("slabcreate");
+  c = &slabs.cache[slabs.n++];
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+  return c;
+}
+
+static void
+slablink(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->slabs;
+  if(s->next)
+    s->next->prev = s;
+  c->slabs = s;
+}
+
+static void
+slabunlink(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->slabs = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Take one object from the slabs, adding a slab if they are
+// all full.  Caller holds c->lock.
+static char*
+slabget(struct slabcache *c)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  if((s = c->slabs) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    o = (char*)(s + 1);
+    for(i = 0; i < c->perslab; i++, o += c->size){
+      *(char**)o = s->free;
+      s->free = o;
+    }
+    slablink(c, s);
+  }
+  o = s->free;
+  s->free = *(char**)o;
+  s->inuse++;
+  if(s->free == 0)
+    slabunlink(c, s);
+  return o;
+}
+
+// Give one object back to its slab.  Caller holds c->lock.
+static void
+slabput(struct slabcache *c, char *o)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)o);
+  if(s->cache != c || s->inuse < 1)
+    panic("slabfree");
+  if(s->free == 0)
+    slablink(c, s);
+  *(char**)o = s->free;
+  s->free = o;
+  if(--s->inuse == 0 && (c->slabs != s || s->next)){
+    slabunlink(c, s);
+    kfree((char*)s);
+  }
+}
+
+// Allocate a zeroed object from cache c.
+// Returns 0 if memory is out.
+void*
+slaballoc(struct slabcache *c)
+{
+  char *o;
+  int n;
+
+  pushcli();
+  n = cpuid();
+  if(c->mag[n].n == 0){
+    acquire(&c->lock);
+    while(c->mag[n].n < MAGSIZE/2 && (o = slabget(c)) != 0)
+      c->mag[n].obj[c->mag[n].n++] = o;
+    release(&c->lock);
+  }
+  o = c->mag[n].n > 0 ? c->mag[n].obj[--c->mag[n].n] : 0;
+  popcli();
+  if(o)
+    memset(o, 0, c->size);
+  return o;
+}
+
+// Free an object allocated from cache c.
+void
+slabfree(struct slabcache *c, void *v)
+{
+  int n;
+
+  pushcli();
+  n = cpuid();
+  if(c->mag[n].n == MAGSIZE){
+    acquire(&c->lock);
+    while(c->mag[n].n > MAGSIZE/2)
+      slabput(c, c->mag[n].obj[--c->mag[n].n]);
+    release(&c->lock);
+  }
+  c->mag[n].obj[c->mag[n].n++] = v;
+  popcli();
+}
@@ -0,0 +1,70 @@
+// Kernel object allocation rate.  Each of n processes creates and
+// closes pipes (a struct pipe and two struct files from the slab
+// caches) and opens and closes a file (a struct file, and an inode
+// found in the inode cache); prints operations per second for
+// n = 1 .. maxproc.  Run under CPUS=1 .. CPUS=8.
+// Usage: slabtest [maxproc [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+void
+pipes(int rounds)
+{
+  int fds[2], i;
+
+  for(i = 0; i < rounds; i++){
+    if(pipe(fds) < 0){
+      printf(1, "slabtest: pipe failed\n");
+      exit();
+    }
+    close(fds[0]);
+    close(fds[1]);
+  }
+}
+
+void
+opens(int rounds)
+{
+  int fd, i;
+
+  for(i = 0; i < rounds; i++){
+    if((fd = open("slabtest.f", O_RDONLY)) < 0){
+      printf(1, "slabtest: open failed\n");
+      exit();
+    }
+    close(fd);
+  }
+}
+
+void
+report(char *what, int n, int rounds, int t)
+{
+  printf(1, "%s: %d procs, ", what, n);
+  benchrate((uint)n * rounds, "ops", t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc, rounds, n, fd;
+
+  maxproc = argc > 1 ? atoi(argv[1]) : 8;
+  rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+  if((fd = open("slabtest.f", O_CREATE|O_RDWR)) < 0){
+    printf(1, "slabtest: create failed\n");
+    exit();
+  }
+  close(fd);
+
+  for(n = 1; n <= maxproc; n++)
+    report("pipe", n, rounds, benchfork(pipes, rounds, n));
+  for(n = 1; n <= maxproc; n++)
+    report("open", n, rounds, benchfork(opens, rounds, n));
+
+  unlink("slabtest.f");
+  exit();
+}
@@ -54,21 +54,43 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+// lies within the process address space, and if the kernel will
+// write to it, that it is writable.
+static int
+argmem(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+     !mmapped(curproc, i, size))
+    return -1;
+  // Fault in pages of the executable and of mmap regions now,
+  // before the system call takes any locks.
+  if(pagein(curproc, i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// A block the kernel only reads.
+int
+argptr(int n, char **pp, int size)
+{
+  return argmem(n, pp, size, 0);
+}
+
+// A block the kernel writes to.
+int
+argwptr(int n, char **pp, int size)
+{
+  return argmem(n, pp, size, 1);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -84,6 +106,12 @@ argstr(int n, char **pp)
 
 extern int sys_chdir(void);
 extern int sys_close(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_shmrm(void);
 extern int sys_dup(void);
 extern int sys_exec(void);
 extern int sys_exit(void);
@@ -126,6 +154,12 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_shmrm]   sys_shmrm,
 };
 
 void
@@ -20,3 +20,9 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_shmget 24
+#define SYS_shmat  25
+#define SYS_shmdt  26
+#define SYS_shmrm  27
@@ -0,0 +1,56 @@
+// TLB reach: reads one word from every page of an mb-megabyte
+// anonymous region, in a scattered order, n times over.  Once with
+// 4KB pages and once with MAP_HUGE's 4MB pages.  The region spans
+// far more 4KB pages than the TLB holds, so with 4KB pages nearly
+// every read misses; with 4MB pages the whole region fits.
+// Usage: tlbbench [mb [n]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mman.h"
+
+#define PGSIZE  4096
+#define STEP    509   // prime, so j*STEP visits every page
+
+int
+run(int flags, int mb, int n)
+{
+  char *p;
+  int npages, i, j, t;
+  volatile int sum;
+
+  p = mmap(0, mb*1024*1024, PROT_READ|PROT_WRITE,
+           MAP_PRIVATE|MAP_ANON|flags, -1, 0);
+  if(p == (char*)-1){
+    printf(1, "tlbbench: mmap failed\n");
+    exit();
+  }
+  npages = mb*1024*1024 / PGSIZE;
+  for(j = 0; j < npages; j++)
+    p[j*PGSIZE] = j;  // fault everything in first
+
+  t = uptime();
+  sum = 0;
+  for(i = 0; i < n; i++)
+    for(j = 0; j < npages; j++)
+      sum += p[((j*STEP) % npages)*PGSIZE];
+  t = benchticks(t);
+  munmap(p, mb*1024*1024);
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, n;
+
+  mb = argc > 1 ? atoi(argv[1]) : 16;
+  n = argc > 2 ? atoi(argv[2]) : 200;
+
+  printf(1, "4KB pages, %d MB passes: ", mb);
+  benchper(n, run(0, mb, n));
+  printf(1, "4MB pages, %d MB passes: ", mb);
+  benchper(n, run(MAP_HUGE, mb, n));
+  exit();
+}
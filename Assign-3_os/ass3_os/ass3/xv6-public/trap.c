@@ -32,6 +32,32 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Page faults that are not errors: a write to a copy-on-write
+// page, or the first touch of a page of the executable or of an
+// mmap region, from user space or from a system call using user
+// memory.  Returns 0 if the fault was handled.
+static int
+pagefault(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+  uint va = rcr2();
+
+  if(p == 0)
+    return -1;
+  if((tf->err & 3) == 3)
+    return cowfault(p->pgdir, va);
+  if(tf->err & 1)
+    return -1;
+  if(mycpu()->ncli > 0){
+    // execfault sleeps; argptr pages in ahead of time.
+    cprintf("page fault with lock held\n");
+    return -1;
+  }
+  if(execfault(p, va) == 0)
+    return 0;
+  return mmapfault(p, va);
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
@@ -78,6 +104,11 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    if(pagefault(tf) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
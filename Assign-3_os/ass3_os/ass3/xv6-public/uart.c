@@ -6,6 +6,7 @@
 #include "traps.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "rwlock.h"
 #include "fs.h"
 #include "file.h"
 #include "mmu.h"
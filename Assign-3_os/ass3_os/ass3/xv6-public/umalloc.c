@@ -2,31 +2,105 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "x86.h"
+#include "mman.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Small requests, up to 2048 bytes, are rounded up to one of NCLASS
+// size classes, each with its own free list, so malloc and free
+// take constant time.  Blocks of a class are carved from CHUNK bytes
+// of sbrk memory at a time and are never given back.  Freed small
+// blocks go to a cache of up to CACHEMAX per class; caches move
+// BATCH blocks at a time to and from the shared lists.  There are
+// NCACHE caches, picked by stack address, so threads running on
+// stacks of their own, as thread_create's do, mostly get a cache of
+// their own and take no shared lock.
+//
+// Requests of BIGALLOC bytes or more get an anonymous mmap region
+// of their own, which free gives back to the kernel.  Requests in
+// between, and big ones when there are no regions left, use the
+// first-fit allocator by Kernighan and Ritchie, The C programming
+// Language, 2nd ed.  Section 8.7.
+
+#define NCLASS    9
+#define CHUNK     (16*1024)
+#define NCACHE    16
+#define CACHEMAX  64
+#define BATCH     (CACHEMAX/2)
+#define STACKSIZE 4096
+#define BIGALLOC  (64*1024)
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;  // next free block; self for an mmap block
+    uint size;          // in Header units, header included
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+// Block sizes of the classes, header included: 8 to 2048 bytes
+// of data.
+static uint classunits[NCLASS] = { 2, 3, 5, 9, 17, 33, 65, 129, 257 };
+
+struct cache {
+  uint lock;
+  Header *list[NCLASS];
+  int n[NCLASS];
+};
+
+static struct cache caches[NCACHE];
+
+// heaplock guards the class lists and the first-fit list.
+static uint heaplock;
+static Header *classlist[NCLASS];
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+static void
+lock(uint *l)
+{
+  while(xchg(l, 1) != 0)
+    ;
+}
+
+static void
+unlock(uint *l)
 {
-  Header *bp, *p;
+  xchg(l, 0);
+}
+
+static struct cache*
+mycache(void)
+{
+  uint sp;
+
+  asm volatile("movl %%esp, %0" : "=r" (sp));
+  return &caches[(sp / STACKSIZE) % NCACHE];
+}
+
+// Size class for a block of nunits, or -1 if it is too big.
+static int
+sizeclass(uint nunits)
+{
+  int i;
+
+  for(i = 0; i < NCLASS; i++)
+    if(nunits <= classunits[i])
+      return i;
+  return -1;
+}
+
+// Put a block back on the first-fit list.  Called with heaplock held.
+static void
+krfree(Header *bp)
+{
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -56,17 +130,16 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  krfree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// First fit.  Called with heaplock held.
+static Header*
+kralloc(uint nunits)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +154,128 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      return p;
     }
     if(p == freep)
       if((p = morecore(nunits)) == 0)
         return 0;
   }
 }
+
+// Move up to BATCH blocks of class i from the shared list to c,
+// carving a new chunk if the shared list is empty.
+static void
+refill(struct cache *c, int i)
+{
+  Header *bp;
+  char *p;
+  uint sz;
+  int k;
+
+  lock(&heaplock);
+  if(classlist[i] == 0){
+    if((p = sbrk(CHUNK)) != (char*)-1){
+      sz = classunits[i] * sizeof(Header);
+      for(k = CHUNK / sz - 1; k >= 0; k--){
+        bp = (Header*)(p + k*sz);
+        bp->s.size = classunits[i];
+        bp->s.ptr = classlist[i];
+        classlist[i] = bp;
+      }
+    }
+  }
+  for(k = 0; k < BATCH && (bp = classlist[i]) != 0; k++){
+    classlist[i] = bp->s.ptr;
+    bp->s.ptr = c->list[i];
+    c->list[i] = bp;
+    c->n[i]++;
+  }
+  unlock(&heaplock);
+}
+
+// Give BATCH blocks of class i from c back to the shared list.
+static void
+drain(struct cache *c, int i)
+{
+  Header *bp;
+  int k;
+
+  lock(&heaplock);
+  for(k = 0; k < BATCH; k++){
+    bp = c->list[i];
+    c->list[i] = bp->s.ptr;
+    c->n[i]--;
+    bp->s.ptr = classlist[i];
+    classlist[i] = bp;
+  }
+  unlock(&heaplock);
+}
+
+void
+free(void *ap)
+{
+  struct cache *c;
+  Header *bp;
+  int i;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.ptr == bp){
+    munmap(bp, bp->s.size * sizeof(Header));
+    return;
+  }
+  if((i = sizeclass(bp->s.size)) >= 0){
+    c = mycache();
+    lock(&c->lock);
+    bp->s.ptr = c->list[i];
+    c->list[i] = bp;
+    if(++c->n[i] > CACHEMAX)
+      drain(c, i);
+    unlock(&c->lock);
+    return;
+  }
+  lock(&heaplock);
+  krfree(bp);
+  unlock(&heaplock);
+}
+
+void*
+malloc(uint nbytes)
+{
+  struct cache *c;
+  Header *p;
+  uint nunits, len;
+  int i;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if((i = sizeclass(nunits)) >= 0){
+    c = mycache();
+    lock(&c->lock);
+    if(c->list[i] == 0)
+      refill(c, i);
+    if((p = c->list[i]) != 0){
+      c->list[i] = p->s.ptr;
+      c->n[i]--;
+      p->s.ptr = 0;
+    }
+    unlock(&c->lock);
+    return p ? (void*)(p + 1) : 0;
+  }
+
+  if(nbytes >= BIGALLOC && nbytes < 0x80000000){
+    len = (nunits * sizeof(Header) + 4095) & ~4095;
+    p = mmap(0, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+    if(p != (Header*)-1){
+      p->s.ptr = p;
+      p->s.size = len / sizeof(Header);
+      return (void*)(p + 1);
+    }
+  }
+
+  lock(&heaplock);
+  if((p = kralloc(nunits)) != 0)
+    p->s.ptr = 0;
+  unlock(&heaplock);
+  return p ? (void*)(p + 1) : 0;
+}
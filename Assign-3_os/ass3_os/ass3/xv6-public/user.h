@@ -23,6 +23,12 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int shmget(int, uint);
+void* shmat(int, void*);
+int shmdt(void*);
+int shmrm(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,3 +43,9 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+
+// bench.c
+int benchticks(int);
+int benchfork(void (*)(int), int, int);
+void benchrate(uint, char*, int);
+void benchper(uint, int);
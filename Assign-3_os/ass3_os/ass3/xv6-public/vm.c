@@ -32,14 +32,17 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
-  if(*pde & PTE_P){
+  if(*pde & PTE_PS){
+    // A 4MB page: the directory entry is the PTE.
+    return pde;
+  } else if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
     if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
@@ -57,7 +60,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -99,6 +102,12 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
+//
+// The kernel half never changes after boot, so kvmalloc() builds it
+// once in kpgdir and setupkvm() copies its directory entries: every
+// page table shares kpgdir's kernel page tables.  The kernel's
+// mappings are marked PTE_G, so switching page tables doesn't flush
+// them from the TLB.
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -114,34 +123,74 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Like mappages, but with 4MB pages for the parts of the range
+// where va and pa are both 4MB aligned, which is most of the
+// kernel's map of physical memory.
+static int
+kmappages(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  while(size > 0){
+    if(va % BIGPGSIZE == 0 && pa % BIGPGSIZE == 0 && size >= BIGPGSIZE){
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+      n = BIGPGSIZE;
+    } else {
+      // 4KB pages up to the next 4MB boundary.
+      n = BIGPGSIZE - va % BIGPGSIZE;
+      if(n > size)
+        n = size;
+      if(mappages(pgdir, (char*)va, n, pa, perm) < 0)
+        return -1;
+    }
+    va += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// Set up a page table with kpgdir's kernel part.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE)*sizeof(pde_t));
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE))*sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes, whose kernel part all other page
+// tables share.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if((kpgdir = (pde_t*)kalloc()) == 0)
+    panic("kvmalloc");
+  memset(kpgdir, 0, PGSIZE);
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(kmappages(kpgdir, (uint)k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm | PTE_G) < 0)
+      panic("kvmalloc");
   switchkvm();
+  kvmglobal();
+}
+
+// Let this CPU keep PTE_G mappings in its TLB across lcr3.
+// Called once kpgdir is in use.
+void
+kvmglobal(void)
+{
+  lcr4(rcr4() | CR4_PGE);
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -192,25 +241,105 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
+// The page at a of segment s of executable ip, and in *perm how to
+// map it.  Pages with file data come from ip's page cache and are
+// shared copy-on-write; with cachedonly, 0 if not cached.  Pages
+// of bss are private.  Caller holds ip->lock.
+static char*
+segpage(struct inode *ip, struct execseg *s, uint a, int cachedonly, uint *perm)
+{
+  char *mem;
+  uint n;
+
+  if(a - s->va < s->filesz){
+    n = s->filesz - (a - s->va);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    *perm = PTE_U|PTE_COW;
+    return ipage(ip, s->off + (a - s->va), n, cachedonly);
+  }
+  if(cachedonly || (mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  *perm = PTE_W|PTE_U;
+  return mem;
+}
+
+// Map into pgdir the pages of segment s that are in ip's page
+// cache already, for exec.  The rest are left to execfault().
+// Caller holds ip->lock.
+void
+mapcached(pde_t *pgdir, struct inode *ip, struct execseg *s)
+{
+  pte_t *pte;
+  uint a, perm;
+  char *mem;
+
+  for(a = s->va; a < s->va + s->filesz; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) != 0 && (*pte & PTE_P))
+      continue;  // segments overlap
+    if((mem = segpage(ip, s, a, 1, &perm)) == 0)
+      continue;
+    if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+      kfree(mem);
+      return;
+    }
+  }
+}
+
+// Read in the page at va of p's executable, which exec left
+// unmapped, and read ahead up to EXECRA-1 more pages of the same
+// segment that are not in yet.  Returns -1 if va is not in one
+// of the executable's segments, or if memory is out.
 int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
+execfault(struct proc *p, uint va)
 {
-  uint i, pa, n;
+  struct execseg *s;
   pte_t *pte;
+  uint a, perm;
+  char *mem;
+  int i;
 
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
+  va = PGROUNDDOWN(va);
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      break;
+  if(s == &p->seg[p->nseg] || p->exe == 0)
+    return -1;
+
+  ilock(p->exe);
+  for(i = 0, a = va; i < EXECRA && a < s->va + s->memsz; i++, a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) != 0 && (*pte & PTE_P))
+      break;
+    if((mem = segpage(p->exe, s, a, 0, &perm)) == 0)
+      break;
+    if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+      kfree(mem);
+      break;
+    }
+  }
+  iunlock(p->exe);
+  return i > 0 ? 0 : -1;
+}
+
+// Read in any pages in [va, va+n) that are not in yet, so that a
+// system call can use them while holding locks.  Returns -1 if one
+// cannot be read, or if write is set and one is read-only: a
+// kernel write to it would fault in kernel mode.
+int
+pagein(struct proc *p, uint va, uint n, int write)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & PTE_P) == 0){
+      if(execfault(p, a) < 0 && mmapfault(p, a) < 0)
+        return -1;
+      pte = walkpgdir(p->pgdir, (char*)a, 0);
+    }
+    if(write && (*pte & (PTE_W|PTE_COW)) == 0)
       return -1;
   }
   return 0;
@@ -288,8 +417,9 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
+  // The kernel's page tables are kpgdir's, shared.
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if((pgdir[i] & (PTE_P|PTE_PS)) == PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
@@ -311,39 +441,68 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  The pages themselves are shared: writable
+// ones become read-only and PTE_COW in both, and cowfault copies
+// them on the first write.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
+    // Pages of the executable not read in yet are read
+    // in by the child itself.
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+      continue;
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    kdup(P2V(pa));
   }
+  lcr3(V2P(pgdir));  // flush the parent's writable TLB entries
   return d;
 
 bad:
+  lcr3(V2P(pgdir));
   freevm(d);
   return 0;
 }
 
+// Handle a write fault at va on a copy-on-write page: copy the
+// page, or if nothing else shares it any more just make it writable
+// again.  Returns -1 if va is not on a COW page or memory is out.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem, *v;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  v = P2V(PTE_ADDR(*pte));
+  if(krefs(v) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, v, PGSIZE);
+    *pte = V2P(mem) | PTE_FLAGS(*pte);
+    kfree(v);
+  }
+  *pte = (*pte | PTE_W) & ~PTE_COW;
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -0,0 +1,109 @@
+// Atomic operations for threads sharing an address space.
+// Include after types.h.
+
+#define CACHELINE 64
+
+// Atomically add v to *addr and return the old value.
+static inline int
+fetch_add(volatile int *addr, int v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return v;
+}
+
+// If *addr == old, set it to new.  Returns the value *addr had,
+// so the swap happened iff the result equals old.
+static inline int
+cmpxchg(volatile int *addr, int old, int new)
+{
+  int prev;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (prev), "+m" (*addr) :
+               "r" (new), "0" (old) :
+               "memory", "cc");
+  return prev;
+}
+
+// Full fence: orders earlier stores before later loads, the one
+// reordering x86 allows.
+static inline void
+mfence(void)
+{
+  asm volatile("mfence" ::: "memory");
+}
+
+// Compiler-only fence.  On x86 this is enough for acquire loads
+// and release stores.
+static inline void
+barrier(void)
+{
+  asm volatile("" ::: "memory");
+}
+
+static inline int
+load_acquire(volatile int *addr)
+{
+  int v = *addr;
+  barrier();
+  return v;
+}
+
+static inline void
+store_release(volatile int *addr, int v)
+{
+  barrier();
+  *addr = v;
+}
+
+// Spin-wait hint.
+static inline void
+cpu_relax(void)
+{
+  asm volatile("pause" ::: "memory");
+}
+
+// Sharded counter: each thread adds to its own cache line, so
+// increments do not bounce a shared line between CPUs.  Reading
+// the total sums the shards.
+#define NSHARD 8
+
+struct shard {
+  volatile int v;
+  char pad[CACHELINE - sizeof(int)];
+} __attribute__((aligned(CACHELINE)));
+
+struct sharded_counter {
+  struct shard shard[NSHARD];
+};
+
+static inline void
+sc_init(struct sharded_counter *c)
+{
+  int i;
+
+  for(i = 0; i < NSHARD; i++)
+    c->shard[i].v = 0;
+}
+
+// Threads with distinct ids below NSHARD never share a line;
+// the add stays atomic in case two ids map to the same shard.
+static inline void
+sc_add(struct sharded_counter *c, int id, int v)
+{
+  fetch_add(&c->shard[id % NSHARD].v, v);
+}
+
+// Combine step.  Exact once the adding threads have been joined.
+static inline int
+sc_read(struct sharded_counter *c)
+{
+  int i, sum = 0;
+
+  for(i = 0; i < NSHARD; i++)
+    sum += load_acquire(&c->shard[i].v);
+  return sum;
+}
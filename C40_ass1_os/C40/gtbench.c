@@ -0,0 +1,131 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "atomic.h"
+
+// Context switch latency: green threads yielding to each other,
+// kernel threads and processes bouncing a byte over a pair of pipes,
+// then many green threads yielding on several carriers.
+// Usage: gtbench [ncarriers [ntasks]]
+
+#define NSWITCH 200000
+#define NROUND 20000
+#define MAXTASKS 20000
+#define TASKYIELDS 10
+
+int fds[2][2];
+volatile int done;
+
+void pingpong(void *arg)
+{
+    int i;
+
+    for (i = 0; i < NSWITCH / 2; i++)
+        gt_yield();
+}
+
+void task(void *arg)
+{
+    int i;
+
+    for (i = 0; i < TASKYIELDS; i++)
+        gt_yield();
+    if ((int)arg == 0)
+        gt_write(1, "gtbench: task 0 wrote through an I/O thread\n", 44);
+    fetch_add(&done, 1);
+}
+
+// Bounce a byte: read on one pipe, write on the other.
+void bounce(int in, int out, int first)
+{
+    char c = 0;
+    int i;
+
+    for (i = 0; i < NROUND; i++)
+    {
+        if (first)
+            write(out, &c, 1);
+        read(in, &c, 1);
+        if (!first)
+            write(out, &c, 1);
+    }
+}
+
+void kthread_bounce(void *arg)
+{
+    bounce(fds[1][0], fds[0][1], 0);
+    thread_exit();
+}
+
+// Nanoseconds per switch; a tick is 10ms.  Worked out in
+// microseconds first so that long runs don't overflow 32 bits.
+void report(char *what, int ticks, int nswitch)
+{
+    uint us = (uint)ticks * 10000;
+
+    printf(1, "%s: %d switches in %d ticks, %d ns/switch\n", what,
+           nswitch, ticks,
+           (int)(us / nswitch * 1000 + us % nswitch * 1000 / nswitch));
+}
+
+int main(int argc, char *argv[])
+{
+    int ncarriers, ntasks, t0, i;
+    void *stack;
+
+    ncarriers = argc > 1 ? atoi(argv[1]) : 2;
+    ntasks = argc > 2 ? atoi(argv[2]) : 10000;
+    if (ntasks > MAXTASKS)
+        ntasks = MAXTASKS;
+
+    // Two kernel threads: each round trip is two switches.
+    pipe(fds[0]);
+    pipe(fds[1]);
+    stack = malloc(4096);
+    t0 = uptime();
+    thread_create(kthread_bounce, 0, stack);
+    bounce(fds[0][0], fds[1][1], 1);
+    thread_join();
+    report("kthread", uptime() - t0, 2 * NROUND);
+    free(stack);
+
+    // Two processes.
+    t0 = uptime();
+    if (fork() == 0)
+    {
+        bounce(fds[1][0], fds[0][1], 0);
+        exit();
+    }
+    bounce(fds[0][0], fds[1][1], 1);
+    wait();
+    report("process", uptime() - t0, 2 * NROUND);
+
+    // Green threads need their stacks set aside before any
+    // kernel thread is running.
+    if (gt_init(MAXTASKS) < 0)
+    {
+        printf(2, "gtbench: gt_init failed\n");
+        exit();
+    }
+
+    // Two green threads on one carrier: every yield is one switch
+    // into the scheduler and one out of it.
+    gt_create(pingpong, 0);
+    gt_create(pingpong, 0);
+    t0 = uptime();
+    gt_run(1, 0);
+    report("green", uptime() - t0, NSWITCH);
+
+    // Many green threads over several carriers.
+    done = 0;
+    for (i = 0; i < ntasks; i++)
+        if (gt_create(task, (void *)i) < 0)
+            break;
+    ntasks = i;
+    t0 = uptime();
+    gt_run(ncarriers, 1);
+    printf(1, "tasks: %d green threads, %d carriers, %d ticks, %d finished\n",
+           ntasks, ncarriers, uptime() - t0, done);
+
+    exit();
+}
@@ -0,0 +1,391 @@
+// Green threads: many user-level threads multiplexed onto a few
+// kernel threads ("carriers") made with thread_create.
+//
+// Switching between green threads never enters the kernel: gswtch
+// swaps stacks the way swtch does in the kernel, and the run queue
+// lock plays the part of ptable.lock.  A green thread holds rqlock
+// across its gswtch to the carrier's scheduler, and the scheduler
+// holds it across gswtch into the next green thread, so no other
+// carrier can pick up a thread whose registers are not yet saved.
+//
+// Blocking reads and writes are handed to a few dedicated I/O kernel
+// threads so that a green thread waiting on a pipe does not take its
+// carrier with it.
+//
+// Each green thread's struct gthread sits at the bottom of its own
+// GT_STACKSIZE-aligned stack, so gt_self() just masks the stack
+// pointer.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "atomic.h"
+
+#define GT_STACKSIZE 2048 // power of two
+#define GT_MAXCARRIERS 8
+#define GT_MAXIO 4
+#define GT_SPINS 1000 // idle polls before a kernel thread sleeps
+
+enum gtstate
+{
+    GT_FREE,
+    GT_RUNNABLE,
+    GT_RUNNING,
+    GT_BLOCKED
+};
+
+enum gtop
+{
+    GT_READ,
+    GT_WRITE
+};
+
+struct gcontext
+{
+    uint edi;
+    uint esi;
+    uint ebx;
+    uint ebp;
+    uint eip;
+};
+
+struct carrier
+{
+    struct gcontext *sched; // gswtch() here to enter the scheduler
+};
+
+struct gthread
+{
+    struct gcontext *ctx;    // gswtch() here to run the thread
+    struct gthread *next;    // run queue, I/O queue or free list
+    struct carrier *carrier; // carrier it is running on
+    enum gtstate state;
+    void (*fn)(void *);
+    void *arg;
+
+    // Pending blocking I/O.
+    enum gtop op;
+    int fd;
+    void *buf;
+    int n;
+    int result;
+};
+
+void gswtch(struct gcontext **, struct gcontext *);
+
+static char *arena;
+static int maxthreads;
+static struct gthread *freelist;
+static struct gthread *rqhead, *rqtail;
+static struct gthread *iohead, *iotail;
+static struct thread_spinlock rqlock;
+static struct thread_spinlock iolock;
+static struct carrier carriers[GT_MAXCARRIERS];
+static char *kstacks[GT_MAXCARRIERS + GT_MAXIO];
+static int nio; // I/O threads in the current gt_run
+static volatile int live; // created and not yet exited
+static volatile int stopping;
+
+static void
+backoff(int *spins)
+{
+    if (++*spins < GT_SPINS)
+    {
+        cpu_relax();
+        return;
+    }
+    sleep(1);
+    *spins = 0;
+}
+
+// Run queue.  Caller holds rqlock.
+static void
+enqueue(struct gthread *g)
+{
+    g->state = GT_RUNNABLE;
+    g->next = 0;
+    if (rqtail)
+        rqtail->next = g;
+    else
+        rqhead = g;
+    rqtail = g;
+}
+
+static struct gthread *
+dequeue(void)
+{
+    struct gthread *g = rqhead;
+
+    if (g)
+    {
+        rqhead = g->next;
+        if (rqhead == 0)
+            rqtail = 0;
+    }
+    return g;
+}
+
+// The green thread running on this stack, or 0 on a kernel
+// thread's own stack.
+static struct gthread *
+gt_self(void)
+{
+    char *sp = (char *)&sp;
+
+    if (arena == 0 || sp < arena || sp >= arena + maxthreads * GT_STACKSIZE)
+        return 0;
+    return (struct gthread *)((uint)sp & ~(GT_STACKSIZE - 1));
+}
+
+// Switch from the current green thread to its carrier's scheduler.
+// Caller holds rqlock; the scheduler releases it.
+static void
+sched(struct gthread *g)
+{
+    gswtch(&g->ctx, g->carrier->sched);
+}
+
+// A new green thread's first gswtch returns here.
+static void
+gt_start(void)
+{
+    struct gthread *g = gt_self();
+
+    // Still holding rqlock from the scheduler.
+    thread_spin_unlock(&rqlock);
+    g->fn(g->arg);
+    gt_exit();
+}
+
+// Set aside stacks for up to max green threads.
+// Call once, before any thread_create.
+int gt_init(int max)
+{
+    char *p;
+    int i;
+
+    if (arena)
+        return -1;
+    for (i = 0; i < GT_MAXCARRIERS + GT_MAXIO; i++)
+        if ((kstacks[i] = malloc(4096)) == 0)
+            return -1;
+    if ((p = sbrk((max + 1) * GT_STACKSIZE)) == (char *)-1)
+        return -1;
+    arena = (char *)(((uint)p + GT_STACKSIZE - 1) & ~(GT_STACKSIZE - 1));
+    maxthreads = max;
+    thread_spin_init(&rqlock);
+    thread_spin_init(&iolock);
+    freelist = 0;
+    for (i = max - 1; i >= 0; i--)
+    {
+        struct gthread *g = (struct gthread *)(arena + i * GT_STACKSIZE);
+        g->state = GT_FREE;
+        g->next = freelist;
+        freelist = g;
+    }
+    return 0;
+}
+
+// Create a green thread running fn(arg).
+// May be called before gt_run() or from a green thread.
+int gt_create(void (*fn)(void *), void *arg)
+{
+    struct gthread *g;
+    char *sp;
+
+    thread_spin_lock(&rqlock);
+    if ((g = freelist) == 0)
+    {
+        thread_spin_unlock(&rqlock);
+        return -1;
+    }
+    freelist = g->next;
+
+    // Set up the stack so the first gswtch "returns" to gt_start,
+    // with an empty slot above it for gt_start's return address.
+    sp = (char *)g + GT_STACKSIZE;
+    sp -= 4;
+    *(uint *)sp = 0;
+    sp -= sizeof(struct gcontext);
+    g->ctx = (struct gcontext *)sp;
+    memset(g->ctx, 0, sizeof(*g->ctx));
+    g->ctx->eip = (uint)gt_start;
+    g->fn = fn;
+    g->arg = arg;
+    live++;
+    enqueue(g);
+    thread_spin_unlock(&rqlock);
+    return 0;
+}
+
+// Give up the carrier to the next runnable green thread.
+void gt_yield(void)
+{
+    struct gthread *g = gt_self();
+
+    if (g == 0)
+        return;
+    thread_spin_lock(&rqlock);
+    enqueue(g);
+    sched(g);
+    thread_spin_unlock(&rqlock);
+}
+
+void gt_exit(void)
+{
+    struct gthread *g = gt_self();
+
+    thread_spin_lock(&rqlock);
+    // The slot cannot be reused before we are off its stack:
+    // gt_create needs rqlock, which the scheduler still holds.
+    g->state = GT_FREE;
+    g->next = freelist;
+    freelist = g;
+    live--;
+    sched(g);
+    printf(2, "gt_exit: zombie returned\n");
+    exit();
+}
+
+// Hand a blocking system call to an I/O thread and run other green
+// threads until it completes.
+static int
+gt_io(enum gtop op, int fd, void *buf, int n)
+{
+    struct gthread *g = gt_self();
+
+    // With no I/O threads, block the carrier.
+    if (g == 0 || nio == 0)
+        return op == GT_READ ? read(fd, buf, n) : write(fd, buf, n);
+    g->op = op;
+    g->fd = fd;
+    g->buf = buf;
+    g->n = n;
+
+    thread_spin_lock(&rqlock);
+    g->state = GT_BLOCKED;
+    g->next = 0;
+    thread_spin_lock(&iolock);
+    if (iotail)
+        iotail->next = g;
+    else
+        iohead = g;
+    iotail = g;
+    thread_spin_unlock(&iolock);
+    sched(g);
+    thread_spin_unlock(&rqlock);
+    return g->result;
+}
+
+int gt_read(int fd, void *buf, int n)
+{
+    return gt_io(GT_READ, fd, buf, n);
+}
+
+int gt_write(int fd, void *buf, int n)
+{
+    return gt_io(GT_WRITE, fd, buf, n);
+}
+
+static void
+io_main(void *arg)
+{
+    struct gthread *g;
+    int spins = 0;
+
+    for (;;)
+    {
+        thread_spin_lock(&iolock);
+        if ((g = iohead) != 0)
+        {
+            iohead = g->next;
+            if (iohead == 0)
+                iotail = 0;
+        }
+        thread_spin_unlock(&iolock);
+        if (g == 0)
+        {
+            if (stopping)
+                break;
+            backoff(&spins);
+            continue;
+        }
+        spins = 0;
+        if (g->op == GT_READ)
+            g->result = read(g->fd, g->buf, g->n);
+        else
+            g->result = write(g->fd, g->buf, g->n);
+        thread_spin_lock(&rqlock);
+        enqueue(g);
+        thread_spin_unlock(&rqlock);
+    }
+    thread_exit();
+}
+
+// Carrier scheduler: run green threads until none are left.
+static void
+schedule(struct carrier *c)
+{
+    struct gthread *g;
+    int spins = 0;
+
+    for (;;)
+    {
+        thread_spin_lock(&rqlock);
+        if ((g = dequeue()) != 0)
+        {
+            g->state = GT_RUNNING;
+            g->carrier = c;
+            gswtch(&c->sched, g->ctx);
+            // The green thread switched back holding rqlock.
+            thread_spin_unlock(&rqlock);
+            spins = 0;
+            continue;
+        }
+        thread_spin_unlock(&rqlock);
+        if (live == 0)
+            return;
+        backoff(&spins);
+    }
+}
+
+static void
+carrier_main(void *arg)
+{
+    schedule((struct carrier *)arg);
+    thread_exit();
+}
+
+// Run the green threads created so far, and any they create, on
+// ncarriers kernel threads (counting the caller) with nio I/O
+// threads.  Returns when every green thread has exited.
+int gt_run(int ncarriers, int niothreads)
+{
+    int i, nthreads = 0;
+
+    if (ncarriers < 1)
+        ncarriers = 1;
+    if (ncarriers > GT_MAXCARRIERS)
+        ncarriers = GT_MAXCARRIERS;
+    if (niothreads < 0)
+        niothreads = 0;
+    if (niothreads > GT_MAXIO)
+        niothreads = GT_MAXIO;
+    nio = niothreads;
+    stopping = 0;
+
+    for (i = 1; i < ncarriers; i++)
+        if (thread_create(carrier_main, &carriers[i], kstacks[i]) >= 0)
+            nthreads++;
+    for (i = 0; i < nio; i++)
+        if (thread_create(io_main, 0, kstacks[GT_MAXCARRIERS + i]) >= 0)
+            nthreads++;
+
+    schedule(&carriers[0]);
+
+    stopping = 1;
+    for (i = 0; i < nthreads; i++)
+        thread_join();
+    nio = 0;
+    return 0;
+}
@@ -7,10 +7,16 @@
 #include "proc.h"
 #include "spinlock.h"
 
+// Ticks a gang keeps priority on the CPUs before the
+// round-robin scan gets a turn.
+#define GANGSLICE 5
+
 struct
 {
   struct spinlock lock;
   struct proc proc[NPROC];
+  int gang;       // key of the gang on the CPUs, or 0
+  uint gangstart; // ticks when it got the CPUs
 } ptable;
 
 static struct proc *initproc;
@@ -90,6 +96,8 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->gang = 0;
+  p->yielded = 0;
 
   release(&ptable.lock);
 
@@ -253,6 +261,8 @@ void exit(void)
   end_op();
   curproc->cwd = 0;
 
+  thread_gang(0);
+
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
@@ -322,6 +332,57 @@ int wait(void)
   }
 }
 
+// Gang scheduling: threads that share an address space and have
+// asked for it with thread_gang() are put on the CPUs together, so a
+// thread spinning on a user lock is less likely to be waiting for a
+// holder that is not running.  A gang is keyed by the pid of the
+// process that owns the address space, in p->gang.  The first gang
+// thread the round-robin scan reaches claims the CPUs for GANGSLICE
+// ticks; until then, or until none of its threads is runnable or
+// running, every CPU picks its threads first.  A thread that gave up
+// the CPU with thread_yield() is passed over in favour of its
+// siblings.
+//
+// This is a priority hint, not strict co-scheduling: no CPU is
+// interrupted when a gang claims the CPUs.  Each picks the gang up
+// at its next scheduling decision, which the timer forces every
+// tick.  Caller holds ptable.lock.
+static struct proc *
+gangpick(struct proc *p)
+{
+  struct proc *q;
+  int running;
+
+  if (ptable.gang && ticks - ptable.gangstart >= GANGSLICE)
+    ptable.gang = 0;
+  if (ptable.gang)
+  {
+    if (p->gang == ptable.gang && !p->yielded)
+      return p;
+    running = 0;
+    for (q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    {
+      if (q->gang != ptable.gang)
+        continue;
+      if (q->state == RUNNABLE && !q->yielded)
+        return q;
+      if (q->state == RUNNING)
+        running = 1;
+    }
+    // While some of the gang is on other CPUs it keeps its claim,
+    // and p only fills this CPU in the meantime.
+    if (running)
+      return p;
+    ptable.gang = 0;
+  }
+  if (p->gang)
+  {
+    ptable.gang = p->gang;
+    ptable.gangstart = ticks;
+  }
+  return p;
+}
+
 // PAGEBREAK: 42
 //  Per-CPU process scheduler.
 //  Each CPU calls scheduler() after setting itself up.
@@ -332,8 +393,9 @@ int wait(void)
 //       via swtch back to the scheduler.
 void scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, *q;
   struct cpu *c = mycpu();
+  int i;
   c->proc = 0;
 
   for (;;)
@@ -343,19 +405,26 @@ void scheduler(void)
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    for (i = 0; i < NPROC; i++)
     {
+      p = &ptable.proc[i];
       if (p->state != RUNNABLE)
         continue;
 
+      // A gang on the CPUs runs ahead of p; p keeps its place.
+      q = gangpick(p);
+      if (q != p)
+        i--;
+
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
+      c->proc = q;
+      switchuvm(q);
+      q->state = RUNNING;
+      q->yielded = 0;
 
-      swtch(&(c->scheduler), p->context);
+      swtch(&(c->scheduler), q->context);
       switchkvm();
 
       // Process is done running for now.
@@ -569,6 +638,7 @@ int thread_create(void (*fcn)(void *), void *arg, void *stack)
   newproc->pgdir = curproc->pgdir;
   newproc->tf->eip = (int)fcn;
   newproc->isthread = 1;
+  newproc->gang = curproc->gang;
   
   newproc->stack = (int)stack;
   newproc->tf->esp = (int)stack + 4092;
@@ -688,4 +758,36 @@ int thread_exit()
   sched();
   panic("Exit zombie");
   return 0;
-}
\ No newline at end of file
+}
+
+// Turn gang scheduling on or off for every thread sharing
+// the caller's address space.
+int thread_gang(int on)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  int key;
+
+  // Threads' parent is the owner of the address space.
+  key = 0;
+  if (on)
+    key = curproc->isthread ? curproc->parent->pid : curproc->pid;
+
+  acquire(&ptable.lock);
+  if (curproc->gang && ptable.gang == curproc->gang)
+    ptable.gang = 0;
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (p->state != UNUSED && p->pgdir == curproc->pgdir)
+      p->gang = key;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Spin-detection hint from a user lock: give up the CPU,
+// preferably to a sibling thread that may hold the lock.
+int thread_yield(void)
+{
+  myproc()->yielded = 1;
+  yield();
+  return 0;
+}
@@ -62,11 +62,15 @@ struct proc
   char name[16];              // Process name (debugging)
   int stack;
   int isthread;
+  int gang;                   // Gang key (owner's pid), or 0 if not gang scheduled
+  int yielded;                // Gave up the CPU in thread_yield()
 };
 
 int thread_create(void (*fcn)(void *), void *, void *);
 int thread_join(void);
 int thread_exit(void);
+int thread_gang(int);
+int thread_yield(void);
 
 // Process memory is laid out contiguously, low addresses first:
 //   text
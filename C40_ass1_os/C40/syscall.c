@@ -106,6 +106,8 @@ extern int sys_uptime(void);
 extern int sys_thread_create(void);
 extern int sys_thread_join(void);
 extern int sys_thread_exit(void);
+extern int sys_thread_gang(void);
+extern int sys_thread_yield(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -131,7 +133,9 @@ static int (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_thread_create] sys_thread_create,
 [SYS_thread_join] sys_thread_join,
-[SYS_thread_exit] sys_thread_exit
+[SYS_thread_exit] sys_thread_exit,
+[SYS_thread_gang] sys_thread_gang,
+[SYS_thread_yield] sys_thread_yield
 };
 
 void
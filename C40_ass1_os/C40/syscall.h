@@ -23,4 +23,6 @@
 #define SYS_thread_create 22
 #define SYS_thread_join 23
 #define SYS_thread_exit 24
+#define SYS_thread_gang 25
+#define SYS_thread_yield 26
 
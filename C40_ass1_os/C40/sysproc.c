@@ -107,3 +107,17 @@ int sys_thread_exit(void)
 {
   return thread_exit();
 }
+
+int sys_thread_gang(void)
+{
+  int on;
+
+  if (argint(0, &on) < 0)
+    return -1;
+  return thread_gang(on);
+}
+
+int sys_thread_yield(void)
+{
+  return thread_yield();
+}
@@ -0,0 +1,124 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "atomic.h"
+
+// The balance workload from thread.c, run three ways:
+//   lock    - one spin lock around each thread's whole loop, as in
+//             thread_spin_lock.c; the threads run one after another
+//   atomic  - fetch_add on the shared balance every iteration
+//   sharded - each thread adds to its own padded shard, and the
+//             shards are combined after the join
+// Between updates each thread spins only a few cycles, so the time
+// is mostly the updates themselves.
+// Usage: thread_atomic [nthreads]
+
+#define MAXTHREADS 8
+#define TOTAL 2000000
+#define WORK 10 // cycles of other work per update
+
+struct balance
+{
+    char name[32];
+    int id;
+    int amount;
+};
+
+volatile int total_balance = 0;
+struct sharded_counter sharded_balance;
+volatile uint lock;
+int mode;
+
+volatile unsigned int delay(unsigned int d)
+{
+    unsigned int i;
+    for (i = 0; i < d; i++)
+    {
+        __asm volatile("nop" ::
+                           :);
+    }
+
+    return i;
+}
+
+void do_work(void *arg)
+{
+    int i;
+    struct balance *b = (struct balance *)arg;
+
+    if (mode == 0)
+        while (xchg(&lock, 1) != 0)
+            cpu_relax();
+
+    for (i = 0; i < b->amount; i++)
+    {
+        delay(WORK);
+        if (mode == 0)
+            total_balance = total_balance + 1;
+        else if (mode == 1)
+            fetch_add(&total_balance, 1);
+        else
+            sc_add(&sharded_balance, b->id, 1);
+    }
+
+    if (mode == 0)
+        store_release((volatile int *)&lock, 0);
+
+    thread_exit();
+    return;
+}
+
+int run(int n)
+{
+    struct balance b[MAXTHREADS];
+    void *s[MAXTHREADS];
+    int i, t0;
+
+    total_balance = 0;
+    sc_init(&sharded_balance);
+    lock = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        b[i].name[0] = 'b';
+        b[i].name[1] = '1' + i;
+        b[i].name[2] = 0;
+        b[i].id = i;
+        b[i].amount = TOTAL / n;
+        s[i] = malloc(4096);
+    }
+
+    t0 = uptime();
+    for (i = 0; i < n; i++)
+        thread_create(do_work, (void *)&b[i], s[i]);
+    for (i = 0; i < n; i++)
+        thread_join();
+    t0 = uptime() - t0;
+
+    for (i = 0; i < n; i++)
+        free(s[i]);
+    return t0;
+}
+
+int main(int argc, char *argv[])
+{
+    static char *names[] = {"lock", "atomic", "sharded"};
+    int n, t, sum;
+
+    n = argc > 1 ? atoi(argv[1]) : 2;
+    if (n < 1)
+        n = 1;
+    if (n > MAXTHREADS)
+        n = MAXTHREADS;
+
+    for (mode = 0; mode < 3; mode++)
+    {
+        t = run(n);
+        sum = mode == 2 ? sc_read(&sharded_balance) : total_balance;
+        printf(1, "%s: %d threads, %d ticks, balance %d (expected %d)\n",
+               names[mode], n, t, sum, (TOTAL / n) * n);
+    }
+
+    exit();
+}
@@ -0,0 +1,132 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// The spin-lock workload from thread_spin_lock.c with the lock taken
+// around each update, competing with CPU-bound processes so threads
+// get descheduled while holding the lock.  Runs three ways:
+//   spin  - pure spinning, the holder's siblings burn their slices
+//   yield - thread_spin_lock, which yields after a long spin
+//   gang  - thread_spin_lock plus gang scheduling
+// Usage: thread_gang [nthreads [nhogs]]
+// Meant to be run with CPUS=2 and CPUS=4.
+
+#define MAXTHREADS 8
+#define MAXHOGS 8
+#define TOTAL 6000
+
+struct balance
+{
+    char name[32];
+    int amount;
+};
+
+volatile int total_balance = 0;
+struct thread_spinlock lock;
+int mode;
+
+volatile unsigned int delay(unsigned int d)
+{
+    unsigned int i;
+    for (i = 0; i < d; i++)
+    {
+        __asm volatile("nop" ::
+                           :);
+    }
+
+    return i;
+}
+
+void do_work(void *arg)
+{
+    int i;
+    int old;
+
+    struct balance *b = (struct balance *)arg;
+
+    for (i = 0; i < b->amount; i++)
+    {
+        if (mode == 0)
+        {
+            while (xchg(&lock.locked, 1) != 0)
+                ;
+        }
+        else
+            thread_spin_lock(&lock);
+        old = total_balance;
+        delay(20000);
+        total_balance = old + 1;
+        thread_spin_unlock(&lock);
+        delay(20000);
+    }
+
+    thread_exit();
+    return;
+}
+
+int run(int n)
+{
+    struct balance b[MAXTHREADS];
+    void *s[MAXTHREADS];
+    int i, t0;
+
+    total_balance = 0;
+    thread_spin_init(&lock);
+    thread_gang(mode == 2);
+    for (i = 0; i < n; i++)
+    {
+        b[i].amount = TOTAL / n;
+        s[i] = malloc(4096);
+    }
+
+    t0 = uptime();
+    for (i = 0; i < n; i++)
+        thread_create(do_work, (void *)&b[i], s[i]);
+    for (i = 0; i < n; i++)
+        thread_join();
+    t0 = uptime() - t0;
+
+    thread_gang(0);
+    for (i = 0; i < n; i++)
+        free(s[i]);
+    return t0;
+}
+
+int main(int argc, char *argv[])
+{
+    static char *names[] = {"spin", "yield", "gang"};
+    int n, nhogs, i, t;
+    int hogs[MAXHOGS];
+
+    n = argc > 1 ? atoi(argv[1]) : 4;
+    nhogs = argc > 2 ? atoi(argv[2]) : 2;
+    if (n < 1)
+        n = 1;
+    if (n > MAXTHREADS)
+        n = MAXTHREADS;
+    if (nhogs > MAXHOGS)
+        nhogs = MAXHOGS;
+
+    for (i = 0; i < nhogs; i++)
+    {
+        if ((hogs[i] = fork()) == 0)
+        {
+            for (;;)
+                delay(1000000);
+        }
+    }
+
+    for (mode = 0; mode < 3; mode++)
+    {
+        t = run(n);
+        printf(1, "%s: %d threads, %d hogs, %d ticks, balance %d (expected %d)\n",
+               names[mode], n, nhogs, t, total_balance, (TOTAL / n) * n);
+    }
+
+    for (i = 0; i < nhogs; i++)
+        kill(hogs[i]);
+    for (i = 0; i < nhogs; i++)
+        wait();
+    exit();
+}
@@ -23,33 +23,6 @@ volatile unsigned int delay(unsigned int d)
     return i;
 }
 
-struct thread_mutex
-{
-    unsigned int lock;
-};
-
-void thread_mutex_init(struct thread_mutex *mlock)
-{
-    mlock->lock = 0;
-}
-
-void thread_mutex_lock(struct thread_mutex *mlock)
-{
-    while (xchg(&mlock->lock, 1) != 0)
-    {
-        sleep(1);
-    }
-    __sync_synchronize();
-}
-
-void thread_mutex_unlock(struct thread_mutex *mlock)
-{
-    __sync_synchronize();
-    asm volatile("movl $0, %0"
-                 : "+m"(mlock->lock)
-                 :);
-}
-
 struct thread_mutex mutex_lock;
 void do_work(void *arg)
 {
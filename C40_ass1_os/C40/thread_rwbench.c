@@ -0,0 +1,133 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "atomic.h"
+
+// Lock contention on a read-mostly lookup table: every thread does
+// OPS lookups and one update in every WRITEEVERY operations, first
+// under a mutex and then under a reader-writer lock.  A barrier
+// starts all threads together; the last phase times barrier rounds.
+// Usage: thread_rwbench [nthreads]
+
+#define MAXTHREADS 8
+#define TABLESIZE 256
+#define OPS 4000
+#define WRITEEVERY 16
+#define ROUNDS 2000
+
+struct entry
+{
+    int key;
+    int value;
+};
+
+struct entry table[TABLESIZE];
+struct thread_mutex mutex;
+struct thread_rwlock rwlock;
+struct thread_barrier bar;
+int use_rwlock;
+volatile int found;
+
+int lookup(int key)
+{
+    int i;
+
+    for (i = 0; i < TABLESIZE; i++)
+        if (table[i].key == key)
+            return table[i].value;
+    return -1;
+}
+
+void do_lookups(void *arg)
+{
+    int id = (int)arg;
+    int i, hits = 0;
+    uint seed = id + 1;
+
+    thread_barrier_wait(&bar);
+    for (i = 0; i < OPS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (i % WRITEEVERY == 0)
+        {
+            if (use_rwlock)
+                thread_rwlock_wrlock(&rwlock);
+            else
+                thread_mutex_lock(&mutex);
+            table[(seed >> 16) % TABLESIZE].value++;
+            if (use_rwlock)
+                thread_rwlock_wrunlock(&rwlock);
+            else
+                thread_mutex_unlock(&mutex);
+            continue;
+        }
+        if (use_rwlock)
+            thread_rwlock_rdlock(&rwlock);
+        else
+            thread_mutex_lock(&mutex);
+        if (lookup((seed >> 16) % (2 * TABLESIZE)) >= 0)
+            hits++;
+        if (use_rwlock)
+            thread_rwlock_rdunlock(&rwlock);
+        else
+            thread_mutex_unlock(&mutex);
+    }
+    fetch_add(&found, hits);
+    thread_exit();
+}
+
+void do_rounds(void *arg)
+{
+    int i;
+
+    for (i = 0; i < ROUNDS; i++)
+        thread_barrier_wait(&bar);
+    thread_exit();
+}
+
+int run(int n, void (*fn)(void *))
+{
+    void *s[MAXTHREADS];
+    int i, t0;
+
+    thread_barrier_init(&bar, n);
+    for (i = 0; i < n; i++)
+        s[i] = malloc(4096);
+    t0 = uptime();
+    for (i = 0; i < n; i++)
+        thread_create(fn, (void *)i, s[i]);
+    for (i = 0; i < n; i++)
+        thread_join();
+    t0 = uptime() - t0;
+    for (i = 0; i < n; i++)
+        free(s[i]);
+    return t0;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, n;
+
+    n = argc > 1 ? atoi(argv[1]) : 2;
+    if (n < 1)
+        n = 1;
+    if (n > MAXTHREADS)
+        n = MAXTHREADS;
+
+    for (i = 0; i < TABLESIZE; i++)
+    {
+        table[i].key = 2 * i;
+        table[i].value = i;
+    }
+    thread_mutex_init(&mutex);
+    thread_rwlock_init(&rwlock);
+
+    use_rwlock = 0;
+    printf(1, "mutex: %d threads, %d ticks\n", n, run(n, do_lookups));
+    use_rwlock = 1;
+    printf(1, "rwlock: %d threads, %d ticks\n", n, run(n, do_lookups));
+    printf(1, "barrier: %d threads, %d rounds, %d ticks\n",
+           n, ROUNDS, run(n, do_rounds));
+
+    exit();
+}
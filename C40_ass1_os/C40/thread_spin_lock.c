@@ -23,32 +23,6 @@ volatile unsigned int delay(unsigned int d)
     return i;
 }
 
-struct thread_spinlock
-{
-    uint locked;
-};
-
-void thread_spin_init(struct thread_spinlock *lk)
-{
-    lk->locked = 0;
-}
-
-void thread_spin_lock(struct thread_spinlock *lk)
-{
-    while (xchg(&lk->locked, 1) != 0)
-    {
-    };
-    __sync_synchronize();
-}
-
-void thread_spin_unlock(struct thread_spinlock *lk)
-{
-    __sync_synchronize();
-    asm volatile("movl $0, %0"
-                 : "+m"(lk->locked)
-                 :);
-}
-
 struct thread_spinlock lock;
 
 void do_work(void *arg)
@@ -0,0 +1,171 @@
+// Synchronization for threads made with thread_create: spin locks,
+// mutexes, reader-writer locks, condition variables and barriers.
+//
+// There is no way to block on a user address, so everything that
+// waits spins for a while and then gives up the CPU with sleep(1),
+// as the mutex always did.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "atomic.h"
+
+#define SPINS 1000 // spins before a waiter sleeps a tick
+
+static void
+backoff(int *spins)
+{
+    if (++*spins < SPINS)
+    {
+        cpu_relax();
+        return;
+    }
+    sleep(1);
+    *spins = 0;
+}
+
+void thread_spin_init(struct thread_spinlock *lk)
+{
+    lk->locked = 0;
+}
+
+void thread_spin_lock(struct thread_spinlock *lk)
+{
+    int spins = 0;
+
+    while (xchg(&lk->locked, 1) != 0)
+    {
+        // A long spin usually means the holder is not running:
+        // give it the CPU.
+        if (++spins >= SPINS)
+        {
+            thread_yield();
+            spins = 0;
+        }
+    };
+    __sync_synchronize();
+}
+
+void thread_spin_unlock(struct thread_spinlock *lk)
+{
+    __sync_synchronize();
+    asm volatile("movl $0, %0"
+                 : "+m"(lk->locked)
+                 :);
+}
+
+void thread_mutex_init(struct thread_mutex *mlock)
+{
+    mlock->lock = 0;
+}
+
+void thread_mutex_lock(struct thread_mutex *mlock)
+{
+    while (xchg(&mlock->lock, 1) != 0)
+    {
+        sleep(1);
+    }
+    __sync_synchronize();
+}
+
+void thread_mutex_unlock(struct thread_mutex *mlock)
+{
+    __sync_synchronize();
+    asm volatile("movl $0, %0"
+                 : "+m"(mlock->lock)
+                 :);
+}
+
+// Reader-writer lock.  cnt is the number of readers, or -1 while a
+// writer holds the lock.  A waiting writer holds off new readers.
+void thread_rwlock_init(struct thread_rwlock *rw)
+{
+    rw->cnt = 0;
+    rw->wwait = 0;
+}
+
+void thread_rwlock_rdlock(struct thread_rwlock *rw)
+{
+    int c, spins = 0;
+
+    for (;;)
+    {
+        c = rw->cnt;
+        if (c >= 0 && rw->wwait == 0 && cmpxchg(&rw->cnt, c, c + 1) == c)
+            return;
+        backoff(&spins);
+    }
+}
+
+void thread_rwlock_rdunlock(struct thread_rwlock *rw)
+{
+    fetch_add(&rw->cnt, -1);
+}
+
+void thread_rwlock_wrlock(struct thread_rwlock *rw)
+{
+    int spins = 0;
+
+    fetch_add(&rw->wwait, 1);
+    while (cmpxchg(&rw->cnt, 0, -1) != 0)
+        backoff(&spins);
+    fetch_add(&rw->wwait, -1);
+}
+
+void thread_rwlock_wrunlock(struct thread_rwlock *rw)
+{
+    store_release(&rw->cnt, 0);
+}
+
+// Condition variable.  Waiters watch a sequence number that every
+// signal bumps, so signal may wake more than one waiter; callers
+// re-check their condition in a loop, as with any condition variable.
+void thread_cond_init(struct thread_cond *cv)
+{
+    cv->seq = 0;
+}
+
+void thread_cond_wait(struct thread_cond *cv, struct thread_mutex *m)
+{
+    int seq = load_acquire(&cv->seq);
+    int spins = 0;
+
+    thread_mutex_unlock(m);
+    while (load_acquire(&cv->seq) == seq)
+        backoff(&spins);
+    thread_mutex_lock(m);
+}
+
+void thread_cond_signal(struct thread_cond *cv)
+{
+    fetch_add(&cv->seq, 1);
+}
+
+void thread_cond_broadcast(struct thread_cond *cv)
+{
+    fetch_add(&cv->seq, 1);
+}
+
+// Sense-reversing barrier for n threads.
+void thread_barrier_init(struct thread_barrier *b, int n)
+{
+    b->n = n;
+    b->count = 0;
+    b->sense = 0;
+}
+
+void thread_barrier_wait(struct thread_barrier *b)
+{
+    int sense = !b->sense;
+    int spins = 0;
+
+    if (fetch_add(&b->count, 1) == b->n - 1)
+    {
+        b->count = 0;
+        store_release(&b->sense, sense);
+        return;
+    }
+    while (load_acquire(&b->sense) != sense)
+        backoff(&spins);
+}
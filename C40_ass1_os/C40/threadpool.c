@@ -0,0 +1,320 @@
+// Work-stealing thread pool on top of thread_create.
+//
+// Every worker owns a Chase-Lev deque of tasks.  The owner pushes
+// and pops at the bottom end without locking; idle workers steal
+// from the top end with a compare-and-swap.  The thread that calls
+// tp_init() is worker 0: it has a deque too, but only runs tasks
+// while it is blocked in tp_wait().
+//
+// Workers find their own deque from the stack they are running on,
+// so only the tp_init() caller and the pool workers may spawn tasks.
+// Nothing here calls malloc() after tp_init(), because the K&R
+// allocator is not thread-safe and sbrk() from a thread does not
+// update the other threads' sz.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "atomic.h"
+
+#define TP_MAXWORKERS 8
+#define TP_DEQUESIZE 1024 // tasks per deque, power of two
+#define TP_STACKSIZE (4 * 4096)
+#define TP_SPINS 2000 // failed steals before an idle worker sleeps
+
+struct tp_task
+{
+    void (*fn)(void *);             // plain task, or 0 for a range
+    void (*body)(int, int, void *); // parallel_for body
+    void *arg;
+    int lo, hi, grain;
+    struct tp_group *group;
+};
+
+struct tp_deque
+{
+    volatile int top;
+    char pad0[60]; // keep thieves' and owner's index on separate lines
+    volatile int bottom;
+    char pad1[60];
+    struct tp_task tasks[TP_DEQUESIZE];
+};
+
+struct tp_worker
+{
+    struct tp_deque dq;
+    char *stack;
+    uint seed;
+};
+
+static struct tp_worker *workers;
+static int nworkers;
+static volatile int stopping;
+
+static void run_range(struct tp_task *t);
+
+// Owner end: add a task at the bottom.  Returns -1 if full.
+static int
+push(struct tp_deque *q, struct tp_task *t)
+{
+    int b = q->bottom;
+
+    if (b - q->top >= TP_DEQUESIZE)
+        return -1;
+    q->tasks[b & (TP_DEQUESIZE - 1)] = *t;
+    store_release(&q->bottom, b + 1);
+    return 0;
+}
+
+// Owner end: take the most recently pushed task.
+static int
+pop(struct tp_deque *q, struct tp_task *t)
+{
+    int b, top;
+
+    b = q->bottom - 1;
+    q->bottom = b;
+    // The store to bottom must be visible before top is read,
+    // otherwise a thief and the owner can both take the last task.
+    mfence();
+    top = q->top;
+    if (top > b)
+    {
+        q->bottom = b + 1;
+        return 0;
+    }
+    *t = q->tasks[b & (TP_DEQUESIZE - 1)];
+    if (top == b)
+    {
+        // Last task: race the thieves for it.
+        if (cmpxchg(&q->top, top, top + 1) != top)
+        {
+            q->bottom = b + 1;
+            return 0;
+        }
+        q->bottom = b + 1;
+    }
+    return 1;
+}
+
+// Thief end: take the oldest task.
+static int
+steal(struct tp_deque *q, struct tp_task *t)
+{
+    int top, b;
+
+    top = load_acquire(&q->top);
+    b = load_acquire(&q->bottom);
+    if (top >= b)
+        return 0;
+    *t = q->tasks[top & (TP_DEQUESIZE - 1)];
+    return cmpxchg(&q->top, top, top + 1) == top;
+}
+
+// Index of the worker running on the current stack.
+static int
+self(void)
+{
+    char *sp = (char *)&sp;
+    int i;
+
+    for (i = 1; i < nworkers; i++)
+        if (sp >= workers[i].stack && sp < workers[i].stack + TP_STACKSIZE)
+            return i;
+    return 0;
+}
+
+static int
+steal_any(int me, struct tp_task *t)
+{
+    struct tp_worker *w = &workers[me];
+    int i, victim;
+
+    if (nworkers < 2)
+        return 0;
+    w->seed = w->seed * 1103515245 + 12345;
+    victim = (w->seed >> 16) % nworkers;
+    for (i = 0; i < nworkers; i++, victim = (victim + 1) % nworkers)
+    {
+        if (victim == me)
+            continue;
+        if (steal(&workers[victim].dq, t))
+            return 1;
+    }
+    return 0;
+}
+
+static void
+run(struct tp_task *t)
+{
+    struct tp_group *g = t->group;
+
+    if (t->fn)
+        t->fn(t->arg);
+    else
+        run_range(t);
+    fetch_add(&g->pending, -1);
+}
+
+static void
+spawn(struct tp_task *t)
+{
+    fetch_add(&t->group->pending, 1);
+    if (push(&workers[self()].dq, t) < 0)
+        run(t); // deque full: run it here
+}
+
+// Split the range in halves, leaving the upper halves for thieves,
+// until it is no larger than grain.
+static void
+run_range(struct tp_task *t)
+{
+    struct tp_task right;
+    int lo = t->lo, hi = t->hi, mid;
+
+    right = *t;
+    while (hi - lo > t->grain)
+    {
+        mid = lo + (hi - lo) / 2;
+        right.lo = mid;
+        right.hi = hi;
+        spawn(&right);
+        hi = mid;
+    }
+    t->body(lo, hi, t->arg);
+}
+
+static void
+worker_main(void *arg)
+{
+    int me = (int)arg;
+    int idle = 0;
+    struct tp_task t;
+
+    while (!stopping)
+    {
+        if (pop(&workers[me].dq, &t) || steal_any(me, &t))
+        {
+            run(&t);
+            idle = 0;
+        }
+        else if (++idle >= TP_SPINS)
+        {
+            sleep(1);
+            idle = 0;
+        }
+        else
+            cpu_relax();
+    }
+    thread_exit();
+}
+
+// Start a pool of n workers, counting the caller.
+// Returns the number of workers, or -1.
+int tp_init(int n)
+{
+    int i;
+
+    if (workers)
+        return -1;
+    if (n < 1)
+        n = 1;
+    if (n > TP_MAXWORKERS)
+        n = TP_MAXWORKERS;
+    if ((workers = malloc(n * sizeof(struct tp_worker))) == 0)
+        return -1;
+    memset(workers, 0, n * sizeof(struct tp_worker));
+    for (i = 0; i < n; i++)
+    {
+        workers[i].seed = i + 1;
+        if (i > 0 && (workers[i].stack = malloc(TP_STACKSIZE)) == 0)
+            goto bad;
+    }
+    stopping = 0;
+    nworkers = 1;
+    for (i = 1; i < n; i++)
+    {
+        // thread_create puts the initial esp 4092 bytes above the
+        // stack argument; hand it the top page of a larger stack.
+        if (thread_create(worker_main, (void *)i,
+                          workers[i].stack + TP_STACKSIZE - 4096) < 0)
+            break;
+        nworkers++;
+    }
+    return nworkers;
+
+bad:
+    for (i = 1; i < n; i++)
+        if (workers[i].stack)
+            free(workers[i].stack);
+    free(workers);
+    workers = 0;
+    return -1;
+}
+
+// Stop the workers and wait for them to exit.
+// Every group must have been waited for.
+void tp_destroy(void)
+{
+    int i;
+
+    if (workers == 0)
+        return;
+    stopping = 1;
+    for (i = 1; i < nworkers; i++)
+        thread_join();
+    for (i = 1; i < nworkers; i++)
+        free(workers[i].stack);
+    free(workers);
+    workers = 0;
+    nworkers = 0;
+}
+
+// Queue fn(arg) as part of group g.
+void tp_spawn(struct tp_group *g, void (*fn)(void *), void *arg)
+{
+    struct tp_task t;
+
+    memset(&t, 0, sizeof(t));
+    t.fn = fn;
+    t.arg = arg;
+    t.group = g;
+    spawn(&t);
+}
+
+// Run queued and stolen tasks until every task of g has finished.
+void tp_wait(struct tp_group *g)
+{
+    int me = self();
+    struct tp_task t;
+
+    while (g->pending > 0)
+    {
+        if (pop(&workers[me].dq, &t) || steal_any(me, &t))
+            run(&t);
+    }
+}
+
+// Call body(lo', hi', arg) over disjoint pieces of [lo, hi) no larger
+// than grain, in parallel, and return when all of them are done.
+void parallel_for(int lo, int hi, int grain,
+                  void (*body)(int, int, void *), void *arg)
+{
+    struct tp_group g;
+    struct tp_task t;
+
+    if (hi <= lo)
+        return;
+    if (grain < 1)
+        grain = 1;
+    g.pending = 0;
+    memset(&t, 0, sizeof(t));
+    t.body = body;
+    t.arg = arg;
+    t.lo = lo;
+    t.hi = hi;
+    t.grain = grain;
+    t.group = &g;
+    run_range(&t);
+    tp_wait(&g);
+}
@@ -0,0 +1,168 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "atomic.h"
+
+// Thread pool benchmark: parallel sum and parallel merge sort.
+// Run as "tpbench N" for N workers and compare the ticks against
+// "tpbench 1" on a kernel booted with CPUS=N.
+
+#define NSUM (1 << 20)
+#define SUMREPS 20
+#define NSORT (1 << 18)
+#define SUMGRAIN 4096
+#define SORTCUTOFF 2048
+
+int *data;
+int *sorted;
+int *tmp;
+volatile int total;
+
+void fill(int *a, int n, uint seed)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        a[i] = (seed >> 8) & 0xffff;
+    }
+}
+
+int sum_serial(int *a, int lo, int hi)
+{
+    int i, s = 0;
+
+    for (i = lo; i < hi; i++)
+        s += a[i];
+    return s;
+}
+
+void sum_body(int lo, int hi, void *arg)
+{
+    fetch_add(&total, sum_serial((int *)arg, lo, hi));
+}
+
+void merge(int *a, int *t, int lo, int mid, int hi)
+{
+    int i = lo, j = mid, k = lo;
+
+    while (i < mid && j < hi)
+        t[k++] = a[i] <= a[j] ? a[i++] : a[j++];
+    while (i < mid)
+        t[k++] = a[i++];
+    while (j < hi)
+        t[k++] = a[j++];
+    memmove(a + lo, t + lo, (hi - lo) * sizeof(int));
+}
+
+void msort(int *a, int *t, int lo, int hi)
+{
+    int mid;
+
+    if (hi - lo < 2)
+        return;
+    mid = lo + (hi - lo) / 2;
+    msort(a, t, lo, mid);
+    msort(a, t, mid, hi);
+    merge(a, t, lo, mid, hi);
+}
+
+struct sortarg
+{
+    int lo, hi;
+};
+
+void pmsort(void *arg)
+{
+    struct sortarg *s = (struct sortarg *)arg;
+    struct sortarg left, right;
+    struct tp_group g;
+    int mid;
+
+    if (s->hi - s->lo <= SORTCUTOFF)
+    {
+        msort(sorted, tmp, s->lo, s->hi);
+        return;
+    }
+    mid = s->lo + (s->hi - s->lo) / 2;
+    left.lo = s->lo;
+    left.hi = mid;
+    right.lo = mid;
+    right.hi = s->hi;
+    g.pending = 0;
+    tp_spawn(&g, pmsort, &left);
+    pmsort(&right);
+    tp_wait(&g);
+    merge(sorted, tmp, s->lo, mid, s->hi);
+}
+
+void report(char *what, int serial, int parallel)
+{
+    int x100;
+
+    if (parallel < 1)
+        parallel = 1;
+    x100 = serial * 100 / parallel;
+    printf(1, "%s: serial %d ticks, pool %d ticks, speedup %d.%d%d\n",
+           what, serial, parallel, x100 / 100, x100 / 10 % 10, x100 % 10);
+}
+
+int main(int argc, char *argv[])
+{
+    int n, i, r, s, t0, ts, tp;
+    struct sortarg all = {0, NSORT};
+
+    n = argc > 1 ? atoi(argv[1]) : 2;
+
+    data = malloc(NSUM * sizeof(int));
+    sorted = malloc(NSORT * sizeof(int));
+    tmp = malloc(NSORT * sizeof(int));
+    if (data == 0 || sorted == 0 || tmp == 0)
+    {
+        printf(2, "tpbench: out of memory\n");
+        exit();
+    }
+    if ((n = tp_init(n)) < 0)
+    {
+        printf(2, "tpbench: tp_init failed\n");
+        exit();
+    }
+    printf(1, "tpbench: %d workers\n", n);
+    fill(data, NSUM, 1);
+
+    t0 = uptime();
+    for (r = 0, s = 0; r < SUMREPS; r++)
+        s += sum_serial(data, 0, NSUM);
+    ts = uptime() - t0;
+
+    t0 = uptime();
+    for (r = 0, total = 0; r < SUMREPS; r++)
+        parallel_for(0, NSUM, SUMGRAIN, sum_body, data);
+    tp = uptime() - t0;
+    if (total != s)
+        printf(1, "sum: MISMATCH %d != %d\n", total, s);
+    report("sum", ts, tp);
+
+    fill(sorted, NSORT, 2);
+    t0 = uptime();
+    msort(sorted, tmp, 0, NSORT);
+    ts = uptime() - t0;
+
+    fill(sorted, NSORT, 2);
+    t0 = uptime();
+    pmsort(&all);
+    tp = uptime() - t0;
+    for (i = 1; i < NSORT; i++)
+    {
+        if (sorted[i - 1] > sorted[i])
+        {
+            printf(1, "sort: NOT SORTED at %d\n", i);
+            break;
+        }
+    }
+    report("sort", ts, tp);
+
+    tp_destroy();
+    exit();
+}
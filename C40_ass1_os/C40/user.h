@@ -1,6 +1,40 @@
 struct stat;
 struct rtcdate;
 
+// Tasks spawned into a group are waited for together.
+struct tp_group
+{
+    volatile int pending;
+};
+
+struct thread_spinlock
+{
+    uint locked;
+};
+
+struct thread_mutex
+{
+    unsigned int lock;
+};
+
+struct thread_rwlock
+{
+    volatile int cnt;
+    volatile int wwait;
+};
+
+struct thread_cond
+{
+    volatile int seq;
+};
+
+struct thread_barrier
+{
+    int n;
+    volatile int count;
+    volatile int sense;
+};
+
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
@@ -26,6 +60,8 @@ int uptime(void);
 int thread_create(void (*fcn)(void *), void *arg, void *stack);
 int thread_join(void);
 int thread_exit(void);
+int thread_gang(int);
+int thread_yield(void);
 
 // ulib.c
 int stat(const char *, struct stat *);
@@ -40,3 +76,38 @@ void *memset(void *, int, uint);
 void *malloc(uint);
 void free(void *);
 int atoi(const char *);
+
+// threadpool.c
+int tp_init(int);
+void tp_destroy(void);
+void tp_spawn(struct tp_group *, void (*)(void *), void *);
+void tp_wait(struct tp_group *);
+void parallel_for(int, int, int, void (*)(int, int, void *), void *);
+
+// thread_sync.c
+void thread_spin_init(struct thread_spinlock *);
+void thread_spin_lock(struct thread_spinlock *);
+void thread_spin_unlock(struct thread_spinlock *);
+void thread_mutex_init(struct thread_mutex *);
+void thread_mutex_lock(struct thread_mutex *);
+void thread_mutex_unlock(struct thread_mutex *);
+void thread_rwlock_init(struct thread_rwlock *);
+void thread_rwlock_rdlock(struct thread_rwlock *);
+void thread_rwlock_rdunlock(struct thread_rwlock *);
+void thread_rwlock_wrlock(struct thread_rwlock *);
+void thread_rwlock_wrunlock(struct thread_rwlock *);
+void thread_cond_init(struct thread_cond *);
+void thread_cond_wait(struct thread_cond *, struct thread_mutex *);
+void thread_cond_signal(struct thread_cond *);
+void thread_cond_broadcast(struct thread_cond *);
+void thread_barrier_init(struct thread_barrier *, int);
+void thread_barrier_wait(struct thread_barrier *);
+
+// gthread.c
+int gt_init(int);
+int gt_create(void (*)(void *), void *);
+void gt_yield(void);
+void gt_exit(void) __attribute__((noreturn));
+int gt_read(int, void *, int);
+int gt_write(int, void *, int);
+int gt_run(int, int);